@@ -0,0 +1,80 @@
+#ifndef BATCHCLASSIFIER_H
+#define BATCHCLASSIFIER_H
+
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "WaitForGraph.h"
+
+struct BatchReport {
+    long graphs = 0;       // rows classified
+    long skipped = 0;      // rows that could not be parsed
+    long unlabeled = 0;    // classified rows without a usable label
+    long truePositive = 0; // predicted and labelled deadlocked
+    long falsePositive = 0;
+    long trueNegative = 0;
+    long falseNegative = 0;
+    double seconds = 0;    // wall time for the whole input
+    double p50Us = 0;      // per-graph parse + build + detect latency
+    double p90Us = 0;
+    double p99Us = 0;
+    double maxUs = 0;
+
+    long labeled() const { return truePositive + falsePositive + trueNegative + falseNegative; }
+    double accuracy() const {
+        return labeled() ? static_cast<double>(truePositive + trueNegative) / labeled() : 0;
+    }
+    double graphsPerSecond() const { return seconds > 0 ? graphs / seconds : 0; }
+};
+
+// Classifies resource-allocation graphs in the deadlock_dataset.csv format:
+//
+//     Graph,Deadlock
+//     "[('P5', 'R1'), ('R1', 'P2'), ...]",0
+//
+// ('P', 'R') is a request and ('R', 'P') an allocation. The graph is folded
+// into a wait-for graph (requester -> each holder) and checked for a cycle
+// with WaitForGraph::hasCycle, on adjacency lists or, for dense graphs, on a
+// bit matrix. This is a cycle-only check: it is exact when every resource
+// has a single instance. With several instances a cycle is necessary but not
+// sufficient, and telling them apart would need each resource's instance
+// count, which the format does not carry; a graph with a cycle is then
+// reported deadlocked even if a free instance could end it.
+//
+// One thread reads rows in batches while worker threads parse and classify
+// them, each rebuilding its graph in place so steady-state rows do not
+// allocate.
+class BatchClassifier {
+public:
+    // Per-worker scratch space reused across rows
+    struct Arena {
+        WaitForGraph graph;
+        std::vector<std::pair<int, int>> requests;    // (process, resource)
+        std::vector<std::pair<int, int>> allocations; // (resource, process)
+        const char* error = nullptr; // why classifyRow last rejected a row
+    };
+    // P and R numbers index the graph's arrays directly, so larger ones are
+    // rejected rather than allocated for.
+    static const int kMaxNodeId = 65535;
+
+private:
+    int threads;
+    int batchRows;
+    WaitForGraph::Engine engine;
+
+public:
+    // threads <= 0 uses every hardware thread.
+    explicit BatchClassifier(int threads = 0, int batchRows = 4096);
+    // Cycle search engine for every graph; Auto picks by size and density.
+    void setEngine(WaitForGraph::Engine choice) { engine = choice; }
+    bool classifyFile(const std::string& path, BatchReport& report, std::string& log);
+    bool classifyStream(std::istream& in, BatchReport& report, std::string& log);
+
+    // Parses one CSV row and reports whether its graph has a cycle. label
+    // is 0 or 1, or -1 if the row has none. Returns false on a malformed row,
+    // with the reason in arena.error.
+    static bool classifyRow(const char* begin, const char* end, Arena& arena, bool& deadlocked, int& label);
+};
+
+#endif // BATCHCLASSIFIER_H
@@ -0,0 +1,64 @@
+#ifndef BITGRAPH_H
+#define BITGRAPH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Directed graph over dense node IDs as a bit adjacency matrix: row v holds
+// one bit per node, set when there is an edge v -> w. Searches keep the
+// unvisited and on-path nodes as bit rows too, so finding a node's next
+// unvisited successor or testing it for a back edge handles 64 nodes per
+// word. A search costs O(nodes * nodes / 64) whatever the number of edges,
+// which beats walking adjacency lists once the average out-degree reaches
+// about nodes / 64; WaitForGraph switches to it then.
+class BitGraph {
+public:
+    // Beyond this the matrix would take more than 2 MB.
+    static const int kMaxNodes = 4096;
+
+private:
+    std::vector<std::uint64_t> rows; // `words` words per row
+    std::size_t words;
+    int count;
+
+    // Scratch state for searches, reused across calls to avoid allocating.
+    mutable std::vector<std::uint64_t> unvisited;
+    mutable std::vector<std::uint64_t> onPath;
+    mutable std::vector<std::pair<int, std::size_t>> stack; // node, word to resume its successors at
+
+    const std::uint64_t* row(int node) const { return rows.data() + node * words; }
+    // Starts a search: every node unvisited, none on the path.
+    void resetMarks() const;
+    // Pushes `node` on the search path; returns the first node on the path
+    // it has an edge to, or -1.
+    int push(int node) const;
+    // Next unvisited successor of the node on top of the path, or -1.
+    int nextChild() const;
+
+public:
+    BitGraph();
+    // Makes room for nodes [0, nodes). Returns false, leaving the matrix
+    // empty, if that is more than kMaxNodes.
+    bool reserve(int nodes);
+    // Frees the matrix.
+    void release();
+    // Removes every node but keeps the storage for the next reserve().
+    void clear();
+    int nodes() const { return count; }
+    std::size_t wordsPerRow() const { return words; }
+
+    void set(int from, int to) { rows[from * words + to / 64] |= std::uint64_t(1) << (to % 64); }
+    void reset(int from, int to) { rows[from * words + to / 64] &= ~(std::uint64_t(1) << (to % 64)); }
+    bool test(int from, int to) const { return (rows[from * words + to / 64] >> (to % 64)) & 1; }
+    void clearRow(int node);
+
+    // A path [from, ..., to] of at least one edge, or empty.
+    std::vector<int> findPath(int from, int to) const;
+    // First cycle found as [t, ..., t], or empty.
+    std::vector<int> findCycle() const;
+    bool hasCycle() const;
+};
+
+#endif // BITGRAPH_H
@@ -0,0 +1,52 @@
+#ifndef CLAIMGRAPH_H
+#define CLAIMGRAPH_H
+
+#include <cstddef>
+#include <vector>
+
+// Claim graph for deadlock avoidance over dense transaction IDs: an edge
+// from -> to means `from` may still request an item `to` holds in a
+// conflicting mode. Edges carry a multiplicity like WaitForGraph's.
+//
+// While the graph is acyclic it keeps a topological order up to date as
+// edges are added (Pearce-Kelly), so asking whether edges into a node would
+// close a cycle costs nothing when they agree with the order and otherwise
+// only searches the nodes ordered between their two ends.
+class ClaimGraph {
+private:
+    struct Edge {
+        int node;
+        int count;
+    };
+    std::vector<std::vector<Edge>> out;
+    std::vector<std::vector<Edge>> in;
+    std::vector<int> order; // position of each node, a permutation; topological while `ordered`
+    bool ordered;
+    std::size_t edgeCount;
+
+    // Scratch state for searches, reused across calls to avoid clearing.
+    std::vector<unsigned> mark;
+    std::vector<int> forward;
+    std::vector<int> backward;
+    std::vector<int> stack;
+    unsigned epoch;
+
+    void reserveNode(int node);
+    unsigned nextEpoch();
+    // Restores the order after a new edge from -> to that points backwards
+    // in it; gives up on the order if the edge closed a cycle.
+    void reorder(int from, int to);
+    // Recomputes the order from scratch; false if the graph has a cycle.
+    bool rebuildOrder();
+
+public:
+    ClaimGraph();
+    void addEdge(int from, int to);
+    void removeEdge(int from, int to);
+    std::size_t size() const { return edgeCount; }
+    // One of `sources` (sorted) that `to` already reaches, or -1. Edges from
+    // all of them to `to` keep the graph acyclic exactly when there is none.
+    int reachedSource(int to, const std::vector<int>& sources);
+};
+
+#endif // CLAIMGRAPH_H
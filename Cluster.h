@@ -0,0 +1,102 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "LockManager.h"
+#include "Transport.h"
+
+// Serves one shard's LockManager to a coordinator. Requests and replies:
+//   "EDGES"       -> "EDGES <count> <waiter> <holder> ..."
+//   "ABORT <tid>" -> "ABORTED <tid> <1 if it was active, else 0>"
+class ShardNode {
+private:
+    LockManager& manager;
+
+public:
+    explicit ShardNode(LockManager& manager) : manager(manager) {}
+    std::string handle(const std::string& request);
+};
+
+// Routes requests over shard LockManagers that each own a contiguous range
+// of DIDs. Every transaction exists on every shard under the same TID, so
+// the shards' wait-for graphs merge into one global graph.
+class LockCluster {
+private:
+    std::vector<std::unique_ptr<LockManager>> shards;
+    std::vector<std::unique_ptr<ShardNode>> nodes;
+    int itemsPerShard;
+    std::mutex addMutex; // keeps TIDs aligned across shards
+
+public:
+    LockCluster(int shardCount, int itemsPerShard);
+    int shardCount() const { return static_cast<int>(shards.size()); }
+    int dataItemCount() const { return shardCount() * itemsPerShard; }
+    int shardOf(int did) const { return did / itemsPerShard; }
+    LockManager& shard(int index) { return *shards[index]; }
+    // Handlers for a Transport, one per shard in order.
+    std::vector<Transport::Handler> handlers();
+
+    int addTransaction();
+    // `did` is global; the owning shard sees it as did % itemsPerShard.
+    bool requestLock(int tid, int did, LockMode mode = LockMode::Exclusive);
+    void releaseLock(int tid, int did);
+    // Restarts `tid` on every shard that terminated it. True if any did.
+    bool restartTransaction(int tid);
+    // Ends `tid` on every shard, in step with addTransaction so freed TIDs
+    // are reused alike everywhere. A commit returns false if some shard
+    // had terminated the transaction; it is then aborted on all of them.
+    bool commitTransaction(int tid);
+    bool abortTransaction(int tid);
+};
+
+struct ClusterDetectorStats {
+    long passes = 0;
+    long deadlocksResolved = 0; // confirmed groups broken
+    long phantoms = 0;          // groups seen once but gone from the confirming snapshot
+    long victims = 0;
+    long messages = 0;          // requests sent to nodes
+    long failedCalls = 0;
+    double detectionMs = 0;     // total wall time of all passes
+};
+
+// Coordinator for deadlocks that span shards: each pass gathers every
+// node's wait-for edges, merges them and looks for deadlocked groups. The
+// snapshots of different nodes are taken at different moments, so a cycle
+// can be a phantom made of waits that never coexisted; a group only counts
+// if it is still there in a second round of snapshots. Victims are then
+// aborted on every node. Where wait counts tie, the highest TID goes first:
+// nodes only report TIDs, and as those are generation-tagged slots, that is
+// an order every node agrees on, not transaction age.
+class ClusterDetector {
+private:
+    Transport& transport;
+    std::chrono::milliseconds interval;
+    ClusterDetectorStats totals;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::thread worker;
+    bool stopping;
+
+    bool collect(std::vector<std::pair<int, int>>& edges, std::string& log);
+    void run();
+
+public:
+    explicit ClusterDetector(Transport& transport);
+    ~ClusterDetector();
+    void setInterval(std::chrono::milliseconds interval);
+    void start();
+    void stop();
+    // One pass. Returns the number of victims; `log` is empty if there was
+    // nothing to do.
+    int runOnce(std::string& log);
+    ClusterDetectorStats stats() const;
+};
+
+#endif // CLUSTER_H
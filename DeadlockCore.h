@@ -0,0 +1,44 @@
+#ifndef DEADLOCKCORE_H
+#define DEADLOCKCORE_H
+
+// Single include for embedding the lock manager without Qt. Link against the
+// deadlockcore library (see CMakeLists.txt).
+//
+//     LockManager manager;
+//     manager.setBlocking(true);
+//     int tid = manager.addTransaction();
+//     int did = manager.addDataItem();
+//     if (manager.requestLock(tid, did, LockMode::Shared)) {
+//         ...
+//     }
+//     manager.commitTransaction(tid); // releases everything; tid is now invalid
+//
+// Operations report what they did as Events. Call manager.events().setLevel()
+// and drain the ring from any thread to log them; formatEvents() turns a
+// batch into text. Overloads taking a std::string& format each call's events
+// on the spot instead. snapshotMetrics() returns counters, lock wait and
+// detection histograms and the most contended items; writeMetrics() saves
+// them as JSON or Prometheus text.
+//
+// A blocking request that would close a cycle is refused at once. To leave
+// such waits to background detection instead, call setOnlineResolution(false)
+// and run a DeadlockDetector.
+//
+// To spread items over several managers, use a LockCluster and run a
+// ClusterDetector over a Transport to its shards' ShardNodes.
+//
+// To compare prevention, detection and victim policies before picking one,
+// run a synthetic or recorded workload through a WorkloadSimulator.
+
+#include "EventLog.h"
+#include "LockManager.h"
+#include "Metrics.h"
+#include "DeadlockDetector.h"
+#include "BatchClassifier.h"
+#include "Simulator.h"
+#include "Cluster.h"
+
+#define DEADLOCKCORE_VERSION_MAJOR 1
+#define DEADLOCKCORE_VERSION_MINOR 0
+
+#endif // DEADLOCKCORE_H
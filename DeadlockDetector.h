@@ -0,0 +1,77 @@
+#ifndef DEADLOCKDETECTOR_H
+#define DEADLOCKDETECTOR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "LockManager.h"
+
+struct DetectorStats {
+    long passes = 0;             // detection runs so far
+    long deadlocksResolved = 0;  // deadlocked groups broken
+    long victims = 0;            // transactions terminated
+    long latencySamples = 0;     // resolved groups whose formation time was known
+    double meanLatencyMs = 0;    // cycle formation to resolution
+    double maxLatencyMs = 0;
+    double detectionMs = 0;      // total wall time spent inside detection passes
+    // CPU time the detecting thread used in them; unlike the wall time it
+    // leaves out waiting for the lock table
+    double detectionCpuMs = 0;
+    std::chrono::milliseconds interval{0}; // delay before the next pass
+};
+
+// Runs deadlock detection without a human in the loop: every interval it
+// finds all deadlocked groups and breaks them with recoverAll. In adaptive
+// mode the interval halves (down to minInterval) when the number of blocked
+// requests grows or a deadlock was found, and doubles (up to maxInterval)
+// while nothing is blocked.
+//
+// Use start()/stop() to run it on its own thread, or call runOnce() from an
+// existing event loop and schedule the next call after the returned delay.
+class DeadlockDetector {
+private:
+    LockManager& manager;
+    std::chrono::milliseconds minInterval;
+    std::chrono::milliseconds maxInterval;
+    std::chrono::milliseconds interval;
+    bool adaptive;
+    long lastBlocked;
+    DetectorStats totals;
+    std::function<void(const std::string&)> reporter;
+
+    mutable std::mutex mutex; // guards everything above
+    std::condition_variable wake;
+    bool stopping;
+    std::thread worker;
+
+    void run();
+    // Logs into *log unless it is null.
+    std::chrono::milliseconds runPass(std::string* log);
+
+public:
+    explicit DeadlockDetector(LockManager& manager);
+    ~DeadlockDetector();
+    DeadlockDetector(const DeadlockDetector&) = delete;
+    DeadlockDetector& operator=(const DeadlockDetector&) = delete;
+
+    // Fixed mode: one pass every `period`.
+    void setFixedInterval(std::chrono::milliseconds period);
+    // Adaptive mode: passes every minPeriod to maxPeriod depending on load.
+    void setAdaptive(std::chrono::milliseconds minPeriod, std::chrono::milliseconds maxPeriod);
+    // Called with the log of every pass that resolved something. On the
+    // detector thread when started with start().
+    void setReporter(std::function<void(const std::string&)> report);
+
+    void start();
+    void stop();
+    bool isRunning() const;
+    // One detection and recovery pass. Returns the delay until the next one.
+    std::chrono::milliseconds runOnce(std::string& log);
+    std::chrono::milliseconds runOnce();
+    DetectorStats stats() const;
+};
+
+#endif // DEADLOCKDETECTOR_H
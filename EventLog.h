@@ -0,0 +1,118 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "LockMode.h"
+
+enum class EventLevel : std::uint8_t { Debug, Info, Warning, Error, Off };
+
+// What a LockManager operation did. Each event is one clause of the
+// operation's log line; the comments list the fields it uses.
+enum class EventType : std::uint8_t {
+    InvalidTransaction,     // tid
+    NoSuchItem,             // did
+    OrderingDenied,         // tid, did, value = highest DID held
+    AlreadyHolds,           // tid, did, mode
+    AlreadyWaiting,         // tid, did
+    Acquired,               // tid, did, mode
+    Upgraded,               // tid, did, mode = mode converted to
+    Waiting,                // tid, did, mode, ids = holders
+    WouldCloseDeadlock,     // tid, did
+    TerminatedWhileWaiting, // tid, did
+    WaitDieAborted,         // tid, did, ids = older conflicting transactions
+    Wounded,                // tid, did, ids = wounded transactions
+    Released,               // tid, did, mode
+    NotHeld,                // tid, did
+    Granted,                // did, ids = new holders
+    DeadlockFormed,         // ids = cycle
+    DeadlockDetected,       // ids = cycle
+    NoDeadlock,
+    NothingToRecover,
+    AlreadyResolved,
+    VictimTerminated,       // tid
+    GroupsDetected,         // value = number of groups
+    Group,                  // ids = members
+    VictimsTerminated,      // value = number of groups, ids = victims
+    NotTerminated,          // tid
+    Restarted,              // tid, value = abort count
+    Covered,                // tid, did, mode, value = ancestor whose lock covers it
+    Escalated,              // tid, did = parent, mode, value = item locks it replaced
+    BatchUnavailable,       // tid, did = first unavailable item, value = batch size, ids = blockers
+    TimedOut,               // tid, did
+    ClaimExceeded,          // tid, did, mode
+    UnsafeDeferred,         // tid, did, mode, value = claimant it could deadlock with
+    Committed,              // tid, value = locks released
+    Aborted                 // tid, value = locks released
+};
+
+// Fixed-size record, so emitting one never allocates. Lists longer than
+// kMaxIds keep their first entries and their full length in `total`.
+struct Event {
+    static const int kMaxIds = 10;
+    std::uint64_t sequence = 0;  // position in the EventLog, set by push
+    std::uint64_t operation = 0; // shared by the events of one call
+    std::int64_t time = 0;       // steady_clock nanoseconds
+    EventType type = EventType::NoDeadlock;
+    LockMode mode = LockMode::Exclusive;
+    std::uint8_t idCount = 0;
+    int tid = -1;
+    int did = -1;
+    int value = 0;
+    int total = 0;
+    int ids[kMaxIds] = {};
+
+    Event() = default;
+    Event(EventType type, int tid = -1, int did = -1) : type(type), tid(tid), did(did) {}
+    template <typename Range>
+    Event& withIds(const Range& range) {
+        idCount = 0;
+        total = 0;
+        for (int id : range) {
+            if (idCount < kMaxIds) ids[idCount++] = id;
+            ++total;
+        }
+        return *this;
+    }
+};
+
+EventLevel eventLevel(EventType type);
+const char* eventLevelName(EventLevel level);
+// One clause, e.g. "T0 acquired lock on D1" or "; D1 granted to T2 T3".
+std::string formatEvent(const Event& event);
+// One line per operation, clauses joined as the string API reports them.
+std::string formatEvents(const std::vector<Event>& events);
+
+// Bounded multi-producer ring of events with a sequence number per slot
+// (Vyukov's queue). push never blocks or allocates; when the ring is full
+// the event is dropped and counted. Events below the level are not kept.
+class EventLog {
+private:
+    struct Slot {
+        std::atomic<std::uint64_t> sequence;
+        Event event;
+    };
+    std::unique_ptr<Slot[]> slots;
+    std::uint64_t mask;
+    std::atomic<EventLevel> minLevel;
+    alignas(64) std::atomic<std::uint64_t> head; // next position to write
+    alignas(64) std::atomic<std::uint64_t> tail; // next position to read
+    std::atomic<std::uint64_t> droppedCount;
+
+public:
+    // Capacity is rounded up to a power of two. Starts at EventLevel::Off.
+    explicit EventLog(std::size_t capacity = 1 << 14);
+    void setLevel(EventLevel level) { minLevel = level; }
+    EventLevel level() const { return minLevel; }
+    bool wants(EventType type) const { return eventLevel(type) >= minLevel.load(std::memory_order_relaxed); }
+    bool push(const Event& event);
+    // Appends up to `max` events, oldest first, to `out`; returns how many.
+    std::size_t drain(std::vector<Event>& out, std::size_t max = SIZE_MAX);
+    std::uint64_t dropped() const { return droppedCount; }
+};
+
+#endif // EVENTLOG_H
@@ -0,0 +1,40 @@
+#ifndef GRAPHLAYOUT_H
+#define GRAPHLAYOUT_H
+
+#include <utility>
+#include <vector>
+
+// Input for one layout pass: the active transactions and the wait-for edges
+// between them, copied out of a LockManager.
+struct GraphSnapshot {
+    std::vector<int> transactions;
+    std::vector<std::pair<int, int>> edges;
+    bool deadlockedOnly = false; // keep only members of cyclic components
+};
+
+// Where to draw each transaction. Deadlocked components get one cluster
+// each, other connected waits one cluster per weakly connected group, and
+// clusters are packed on shelves so the drawing grows with the square root
+// of its size instead of one circle that grows with every transaction.
+struct GraphLayout {
+    struct Node {
+        int tid;
+        double x, y;   // centre
+        int component; // index into components, or -1 if not deadlocked
+    };
+    std::vector<Node> nodes;                 // sorted by TID
+    std::vector<std::pair<int, int>> edges;  // edges between laid-out nodes
+    std::vector<std::vector<int>> components; // deadlocked groups, as WaitForGraph reports them
+    int collapsedIdle = 0; // transactions neither waiting nor waited on that were left out
+    double summaryX = 0, summaryY = 0; // where to put a label for them
+
+    // Transactions with no edges are drawn only while there are at most this many.
+    static const int kMaxIdleShown = 64;
+
+    // Pure function of the snapshot; safe to run on a worker thread.
+    static GraphLayout compute(const GraphSnapshot& snapshot);
+    // Index of `tid` in nodes, or -1.
+    int find(int tid) const;
+};
+
+#endif // GRAPHLAYOUT_H
@@ -0,0 +1,42 @@
+#ifndef IDSET_H
+#define IDSET_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Sorted flat set of small integer IDs. Lock sets are usually a handful of
+// entries, so a contiguous sorted array beats node-based std::set for both
+// lookups and iteration, and keeps its capacity across clear() so steady-state
+// lock traffic does not allocate.
+class IdSet {
+private:
+    std::vector<int> ids;
+
+public:
+    typedef std::vector<int>::const_iterator const_iterator;
+
+    bool insert(int id) {
+        auto it = std::lower_bound(ids.begin(), ids.end(), id);
+        if (it != ids.end() && *it == id) return false;
+        ids.insert(it, id);
+        return true;
+    }
+    bool erase(int id) {
+        auto it = std::lower_bound(ids.begin(), ids.end(), id);
+        if (it == ids.end() || *it != id) return false;
+        ids.erase(it);
+        return true;
+    }
+    bool contains(int id) const {
+        return std::binary_search(ids.begin(), ids.end(), id);
+    }
+    void clear() { ids.clear(); }
+    bool empty() const { return ids.empty(); }
+    std::size_t size() const { return ids.size(); }
+    int max() const { return ids.back(); } // requires !empty()
+    const_iterator begin() const { return ids.begin(); }
+    const_iterator end() const { return ids.end(); }
+};
+
+#endif // IDSET_H
@@ -2,48 +2,524 @@
 #define LOCKMANAGER_H
 
 #include <vector>
-#include <set>
-#include <map>
 #include <string>
+#include <utility>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <queue>
+#include <thread>
+#include "ClaimGraph.h"
+#include "EventLog.h"
+#include "IdSet.h"
+#include "LockMode.h"
+#include "Metrics.h"
+#include "WaitForGraph.h"
 
-struct Transaction {
-    int id;
-    std::set<int> heldLocks;
-    std::set<int> waitingFor;
-    bool active;
-    Transaction(int tid) : id(tid), active(true) {}
+// How recovery picks the transaction to abort from a deadlocked group.
+enum class VictimPolicy {
+    Youngest,     // latest start timestamp
+    FewestLocks,  // fewest locks held
+    LeastWork,    // fewest locks granted since (re)start
+    WeightedCost  // weighted sum of the above inputs plus previous aborts
 };
 
-struct DataItem {
-    int id;
-    DataItem(int did) : id(did) {}
+// Deadlock prevention schemes. LockOrdering denies requests that break
+// ascending DID order; the timestamp schemes compare start timestamps with
+// every transaction the request would wait for and abort instead of waiting
+// whenever the wait could point from a younger to an older transaction
+// (wait-die) or from an older to a younger one (wound-wait). Avoidance
+// needs claims declared up front and holds back, without aborting anyone,
+// grants after which the claims could no longer all be met (Banker's rule)
+// until they can be made safely.
+enum class PreventionMode {
+    None,
+    LockOrdering,
+    WaitDie,   // an older requester waits, a younger one is aborted
+    WoundWait, // an older requester aborts younger conflicting ones, a younger one waits
+    Avoidance  // only grants that keep the claim graph acyclic
 };
 
+// How an asynchronous lock request ended.
+enum class LockOutcome {
+    Granted,
+    Refused,  // invalid, denied by prevention, withdrawn to break a cycle, or cancelled by a release
+    Aborted,  // the transaction was terminated, e.g. as a deadlock victim
+    TimedOut
+};
+
+struct VictimWeights {
+    double perLockHeld = 1.0;
+    double perGrant = 1.0;
+    double perAbort = 4.0;
+};
+
+// LockManager is safe to call from several threads at once. Data items are
+// hash-sharded over lock stripes so requests on different items proceed in
+// parallel; adding transactions/items and deadlock detection/recovery briefly
+// take the whole table. A transaction must be driven by one thread at a time.
 class LockManager {
 private:
-    std::vector<Transaction> transactions;
-    std::vector<int> dataItems;
-    std::map<int, int> lockTable; // did -> tid, -1 if free
-    bool preventionEnabled;
-    int nextTid;
+    static const int kLockStripes = 64;
+    struct LockStripe {
+        std::mutex mutex;
+        std::condition_variable released; // signalled when an item's holders or queue change
+        unsigned long version = 0;         // bumped on every signal, guards against lost wake-ups
+        std::vector<int> changedItems;     // DIDs whose holders changed since takeChanges
+    };
+    // An asynchronous request: the items still to lock (missing ancestor
+    // intentions, then the item itself) and the callback to run once. While
+    // it waits, the queue entry of targets[next] points at it.
+    struct AsyncRequest {
+        int tid;
+        int did;
+        LockMode mode;
+        std::vector<int> targets;
+        std::atomic<size_t> next{0}; // advanced by grantWaiters, which also posts the next step
+        std::chrono::steady_clock::time_point deadline;
+        std::function<void(LockOutcome)> done;
+        std::atomic<bool> finished{false};
+        bool timed = false;
+        bool nested = false;
+    };
+    // A queued request. Upgrades (a holder asking for a stronger mode, queued
+    // with the mode it converts to) go ahead of ordinary requests so they are
+    // not starved by later readers.
+    struct LockRequest {
+        int tid;
+        LockMode mode;
+        bool upgrade;
+        std::int64_t waitingSince; // steady clock ns once the request has to wait, else 0
+        std::shared_ptr<AsyncRequest> async; // set while an asynchronous request waits here
+        int unsafeWith; // claimant a grant could deadlock with while it is deferred, else -1
+    };
+    // Outcome of one pass of requestLock under the shared registry; Die and
+    // Wound need the registry exclusively to abort transactions. Queued is
+    // only returned for asynchronous requests left waiting.
+    enum class Attempt { Granted, Refused, Die, Wound, Queued };
+    // Work for the async thread: run the next step of a request, or
+    // complete one that was settled under the manager's locks.
+    struct AsyncTask {
+        std::shared_ptr<AsyncRequest> request;
+        bool complete;
+        LockOutcome outcome;
+    };
+    struct AsyncTimer {
+        std::chrono::steady_clock::time_point deadline;
+        std::weak_ptr<AsyncRequest> request;
+        bool operator>(const AsyncTimer& other) const { return deadline > other.deadline; }
+    };
+    // Where one call's events go: the event log when its level wants them,
+    // and `text` when the caller asked for a log string. While `held` is set
+    // events are parked there, so a summary can be emitted ahead of them.
+    struct Trace {
+        std::vector<Event>* text = nullptr;
+        std::vector<Event>* held = nullptr;
+        std::uint64_t operation = 0;
+    };
+
+    // Data items get dense sequential IDs and transactions dense slots, so
+    // their state is kept as parallel arrays indexed directly by DID / slot.
+    // A TID is its slot tagged with the slot's generation in the bits above
+    // kSlotBits; a finished transaction's slot goes back to freeSlots, and
+    // the bumped generation makes its old TID invalid.
+    static const int kSlotBits = 20;
+    static const int kSlotMask = (1 << kSlotBits) - 1;
+    std::vector<int> txTid;        // TID in each slot, -1 while it is free
+    std::vector<int> txGeneration; // times each slot was reused
+    std::deque<int> freeSlots;     // oldest first, so a generation lasts as long as possible
+    std::vector<char> txActive;
+    std::vector<IdSet> txHeld;     // DIDs held by each transaction
+    std::vector<IdSet> txWaiting;  // DIDs each transaction has a queued request on
+    std::vector<long> txStart;     // start timestamp, kept across restarts
+    std::vector<int> txWork;       // locks granted since the last (re)start
+    std::vector<int> txAborts;     // times chosen as a deadlock victim
+    std::vector<std::chrono::steady_clock::time_point> txDeadlockedSince; // first cycle seen while waiting
+    std::vector<std::vector<std::pair<int, int>>> txChildLocks; // (parent, locks held directly below it), by parent
+    // (item, items below it held only through an escalated lock), so they can
+    // still be released one by one
+    std::vector<std::vector<std::pair<int, IdSet>>> txCovered;
+    std::vector<std::vector<int>> txClaimed; // items with a claim of the transaction, to drop them when it ends
+    std::vector<char> txChanged;   // listed in txChangedByLatch since takeChanges
+    std::vector<char> itemChanged; // listed in its stripe's changedItems since takeChanges
+    std::vector<IdSet> itemHolders; // TIDs holding each item
+    std::vector<std::vector<LockMode>> itemHolderModes; // each holder's mode, in itemHolders order
+    std::vector<LockMode> itemMode; // group mode: the weakest mode covering every holder's
+    std::vector<int> itemParent;     // enclosing item in the hierarchy, -1 at the top
+    std::vector<int> itemChildCount; // items directly below each item
+    std::vector<std::vector<LockRequest>> itemQueue; // FIFO wait queue per item
+    // (tid, mode) of each transaction that declared a claim on the item, by
+    // TID; ancestors of a claimed item carry the matching intention mode.
+    // Fixed from the transaction's start to its end.
+    std::vector<std::vector<std::pair<int, LockMode>>> itemClaims;
+    // Requests on each item that had to wait. Counted under the item's stripe
+    // but atomic, so a snapshot can read them all without taking the stripes;
+    // a deque, so adding items never moves them.
+    std::deque<std::atomic<std::uint64_t>> itemWaits;
+    WaitForGraph waitForGraph; // kept in sync with itemHolders and itemQueue; nodes are slots
+    // Claimant -> holder slots for every holder whose mode conflicts with a
+    // claim on the item. Avoidance keeps it acyclic, so some order always lets
+    // every transaction get all it claimed.
+    ClaimGraph claimGraph;
+    // Items with a request deferred as unsafe, guarded by graphMutex; the
+    // count can be read without it.
+    IdSet deferredItems;
+    std::atomic<int> deferredItemCount;
+    std::atomic<PreventionMode> preventionMode;
+    std::atomic<bool> blocking;
+    std::atomic<bool> onlineResolution;
+    std::atomic<long> queuedRequests;
+    std::atomic<int> escalationThreshold;
     int nextDid;
+    long clock; // logical clock for start timestamps
+    VictimPolicy victimPolicy;
+    VictimWeights victimWeights;
+    int starvationLimit;
+    EventLog eventLog;
+    LockMetrics lockMetrics;
+    std::atomic<std::uint64_t> nextOperation;
+
+    // Lock order: registryMutex -> stripe mutex -> transaction latch -> graphMutex.
+    // Item state is guarded by its stripe, txHeld/txWaiting by the transaction
+    // latch (a release may hand an item to a waiter driven by another thread).
+    mutable std::shared_mutex registryMutex; // exclusive for table growth, detection and recovery
+    LockStripe stripes[kLockStripes];
+    std::mutex txLatches[kLockStripes];
+    std::vector<int> txChangedByLatch[kLockStripes]; // TIDs changed since takeChanges, per latch
+    std::mutex graphMutex; // guards waitForGraph and claimGraph
+    // Async thread state, taken last in the lock order.
+    std::mutex asyncMutex;
+    std::condition_variable asyncWake;
+    std::deque<AsyncTask> asyncTasks;
+    std::priority_queue<AsyncTimer, std::vector<AsyncTimer>, std::greater<AsyncTimer>> asyncTimers;
+    std::thread asyncThread;
+    bool asyncStopping;
 
+    LockStripe& stripeFor(int did) { return stripes[did % kLockStripes]; }
+    std::mutex& latchFor(int tid) { return txLatches[slotOf(tid) % kLockStripes]; }
+    void wakeWaiters(int did);
+    static int slotOf(int tid) { return tid & kSlotMask; }
+    // Started and not yet committed or aborted; possibly terminated.
+    bool knownTransaction(int tid) const {
+        return tid >= 0 && slotOf(tid) < static_cast<int>(txTid.size()) && txTid[slotOf(tid)] == tid;
+    }
+    bool validTransaction(int tid) const { return knownTransaction(tid) && txActive[slotOf(tid)]; }
+    // Turns graph nodes back into TIDs.
+    void toTids(std::vector<int>& slots) const {
+        for (int& slot : slots) slot = txTid[slot];
+    }
+    bool validItem(int did) const { return did >= 0 && did < nextDid; }
+    bool holdsAtLeast(int tid, int did, LockMode mode) const;
+    bool compatibleWithOthers(int did, int tid, LockMode mode) const;
+    // Add, change or drop one holder, keeping itemHolderModes, the group
+    // mode and the claim graph in step. Caller holds the stripe.
+    // `claimsLinked` says claimGrants already updated the claim graph.
+    void setHolder(int did, int tid, LockMode mode, bool claimsLinked = false);
+    bool dropHolder(int did, int tid);
+    // Adds (or removes) the claim edges from `did`'s claimants to `holder`
+    // holding it in `mode`. Caller holds graphMutex.
+    void linkClaims(int did, int holder, LockMode mode, bool add);
+    bool claimConflicts(int did, int tid, LockMode mode) const;
+    // Granting items to `tid` adds claim edges into it, which close a cycle
+    // exactly when `tid` already reaches one of their claimants. With
+    // avoidance on, returns such a claimant and changes nothing but listing
+    // `deferring`, if given, in deferredItems; checking and listing under one
+    // lock means a release that makes the grant safe always finds the item.
+    // Otherwise links the grants' claim edges and returns -1. Caller holds
+    // the stripes.
+    int claimGrants(int tid, const std::vector<std::pair<int, LockMode>>& grants, int deferring = -1);
+    // True if `tid` declared a claim on `did`, or on an ancestor, that
+    // allows `mode`.
+    bool claimCovers(int tid, int did, LockMode mode) const;
+    // Per-transaction hierarchy bookkeeping; caller holds the transaction latch.
+    void countChild(int tid, int did, int delta);
+    int childLocks(int tid, int parent) const;
+    IdSet* coverageOf(int tid, int did);
+    IdSet& coverageFor(int tid, int did);
+    void dropCoverage(int tid, int did); // for `did` and everything below it
+    bool isBelow(int did, int ancestor) const;
+    // Record a row for takeChanges. Callers hold the transaction latch or the
+    // item's stripe respectively (or the registry exclusively).
+    void markTransaction(int tid);
+    void markItem(int did);
+    void emit(Trace& trace, Event event);
+    void emitGrants(Trace& trace, const std::vector<int>& granted, int did);
+    bool requestLock(int tid, int did, LockMode mode, Trace& trace);
+    // Lists the ancestors of `did` still missing their intention lock, top
+    // first. Returns true if a lock on an ancestor already covers the request.
+    bool planLock(int tid, int did, LockMode mode, Trace& trace, std::vector<int>& missing, bool& nested);
+    // One item without its ancestors, retried after wait-die/wound-wait aborts.
+    bool lockItem(int tid, int did, LockMode mode, Trace& trace);
+    // Handles a Die or Wound attempt; returns true if the request may retry.
+    bool resolveConflicts(int tid, int did, Attempt attempt, std::vector<int>& conflicts, Trace& trace);
+    // Locks request->targets from `next` on until one has to wait, then
+    // returns; the grant of that one posts the next step. Runs with no locks held.
+    void stepAsync(const std::shared_ptr<AsyncRequest>& request);
+    // Finishes a request once: gives back intention locks it no longer
+    // needs and runs its callback. completeAsync runs it here and must be
+    // called with no locks held; postCompletion hands it to the async thread.
+    void completeAsync(const std::shared_ptr<AsyncRequest>& request, LockOutcome outcome);
+    void postCompletion(const std::shared_ptr<AsyncRequest>& request, LockOutcome outcome);
+    void postStep(const std::shared_ptr<AsyncRequest>& request);
+    // Withdraws a request still waiting at its deadline.
+    void expireAsync(const std::shared_ptr<AsyncRequest>& request);
+    void runAsync();
+    bool requestLocks(int tid, const std::vector<int>& dids, LockMode mode, Trace& trace);
+    // Grants wanted[next...] in order under all their stripes at once, up to
+    // the first entry that would have to wait, and returns true if none did.
+    // `next` is left on that entry. With `partial` false nothing is granted
+    // unless everything can be. Granted entries are appended to `taken` with
+    // the mode held before, or -1. Caller holds the registry shared.
+    bool grantBatch(int tid, const std::vector<std::pair<int, LockMode>>& wanted, size_t& next, bool partial,
+                    std::vector<std::pair<int, int>>& taken, Trace& trace);
+    // Puts a lock converted by a failed batch back to its earlier mode.
+    void restoreMode(int tid, int did, LockMode mode, Trace& trace);
+    void releaseLock(int tid, int did, Trace& trace);
+    // The callers below hold the registry shared. releaseItem gives up a held
+    // lock and returns false if there is none; withdrawRequest drops a queued one.
+    bool releaseItem(int tid, int did, Trace& trace, bool report);
+    void withdrawRequest(int tid, int did, Trace& trace);
+    // Walks up from `did` releasing ancestor locks nothing below needs any
+    // more: intention locks, escalated locks, and items held through one.
+    void releaseUnneeded(int tid, int did, Trace& trace);
+    // Swaps this transaction's locks below did's parent for one S or X lock
+    // on it once there are escalationThreshold of them, if that lock can be
+    // taken without waiting.
+    void escalate(int tid, int did, Trace& trace);
+    bool detectDeadlock(Trace& trace, std::vector<int>& cycle);
+    void recover(const std::vector<int>& cycle, Trace& trace);
+    bool detectAllDeadlocks(Trace& trace, std::vector<std::vector<int>>& components);
+    void recoverAll(const std::vector<std::vector<int>>& components, Trace& trace, std::vector<int>& victims);
+    bool restartTransaction(int tid, Trace& trace);
+    bool terminateVictim(int tid, Trace& trace);
+    Attempt attemptLock(int tid, int did, LockMode mode, Trace& trace, std::vector<int>& conflicts,
+                        const std::shared_ptr<AsyncRequest>& async = nullptr);
+    // Transactions a new request would wait for: incompatible holders and
+    // incompatible requests queued ahead of it, holders first and the queue
+    // in order. Caller holds the stripe.
+    std::vector<int> blockersOf(int tid, int did, LockMode mode, bool upgrade) const;
     std::vector<int> findCycle();
-    bool dfsCycle(int tid, const std::map<int, std::set<int>>& waitForGraph,
-                  std::set<int>& visited, std::vector<int>& path, std::vector<int>& cycle);
+    // Aborts `tid` and hands its items to queued waiters. Caller holds the
+    // registry exclusively.
+    void terminate(int tid, Trace& trace);
+    // Drops everything `tid` holds or waits for; queued asynchronous
+    // requests complete with `outcome`. Caller holds the registry exclusively.
+    void releaseAll(int tid, LockOutcome outcome, Trace& trace);
+    bool finishTransaction(int tid, bool commit, Trace& trace);
+    // Lower is a better victim. Transactions aborted starvationLimit times or
+    // more are only picked when every candidate is in the same position.
+    double victimCost(int tid) const;
+    // Cheapest candidate by victimCost; ties go to the latest txStart, since
+    // a reused slot's TID says nothing about age.
+    int chooseVictim(const std::vector<int>& candidates) const;
+
+    // Item state changes follow one pattern: snapshot itemEdges(did), mutate
+    // holders or queue, grantWaiters(did), then relinkItem(did, snapshot),
+    // which swaps the item's wait-for edges and returns cycles closed by the
+    // edges that are new.
+    std::vector<std::pair<int, int>> itemEdges(int did) const;
+    std::vector<std::vector<int>> relinkItem(int did, const std::vector<std::pair<int, int>>& before);
+    // With claims, a request that would be granted but is unsafe is
+    // deferred instead: it stays queued, waiting for the claimant it could
+    // deadlock with, and requests behind it may go first. It is reported
+    // here unless it is `requester`'s.
+    std::vector<int> grantWaiters(int did, int requester = -1);
+    // Runs grantWaiters again on every item with a deferred request, since
+    // a release or a finished transaction may have made it safe. Caller
+    // holds the registry but no stripe.
+    void grantDeferred(Trace& trace);
+    // Drops tid's queued request on `did`; an asynchronous one completes with `outcome`.
+    void removeRequest(int tid, int did, LockOutcome outcome = LockOutcome::Refused);
+    // Reports cycles closed on `did`; in blocking mode with online resolution
+    // the waiters whose new edge closed each cycle have their requests
+    // withdrawn, otherwise the cycle is stamped for detection latency.
+    void settleCycles(int did, std::vector<std::vector<int>> cycles, Trace& trace);
+    bool cycleIntact(const std::vector<int>& cycle);
 
 public:
     LockManager();
-    int addTransaction();
-    int addDataItem();
-    bool requestLock(int tid, int did, std::string& log);
+    ~LockManager();
+    // Begins a transaction. Its TID stays valid until it is committed or
+    // aborted; the slot behind it is then reused, under a new TID.
+    int addTransaction() { return addTransaction(std::vector<int>()); }
+    // Declares the items the transaction may lock, in `mode` or weaker;
+    // descendants of a claimed item are included. Only avoidance enforces
+    // claims: it refuses requests outside them and defers grants that would
+    // be unsafe until they are not. Returns -1 if an item does not exist, or if 2^20 transactions
+    // are already running.
+    int addTransaction(const std::vector<int>& claims, LockMode mode = LockMode::Exclusive);
+    // Ends an active transaction: releases all its locks, withdraws its
+    // queued requests (asynchronous ones complete as Refused) and frees its
+    // TID. Returns false, changing nothing, if it is not active.
+    bool commitTransaction(int tid, std::string& log);
+    bool commitTransaction(int tid) {
+        Trace trace;
+        return finishTransaction(tid, true, trace);
+    }
+    // Same for an active or terminated transaction, e.g. a deadlock victim
+    // that will not be restarted; asynchronous requests complete as Aborted.
+    bool abortTransaction(int tid, std::string& log);
+    bool abortTransaction(int tid) {
+        Trace trace;
+        return finishTransaction(tid, false, trace);
+    }
+    // `parent` places the item below another one, e.g. a row in a table or
+    // a table in a database. Returns -1 if the parent does not exist.
+    int addDataItem(int parent = -1);
+    // Requesting an item below others first takes the matching intention
+    // lock (IS for S and IS, IX otherwise) on each ancestor from the top
+    // down; a lock already held on an ancestor that covers the request grants
+    // it outright. Releasing an item also releases everything the
+    // transaction holds below it and ancestor locks that are no longer needed.
+    // Operations emit Events into events(). The overloads taking a log
+    // string also format that call's events into it; the others never build
+    // a string, so hot paths only pay for events the log's level keeps.
+    bool requestLock(int tid, int did, LockMode mode, std::string& log);
+    bool requestLock(int tid, int did, std::string& log) {
+        return requestLock(tid, did, LockMode::Exclusive, log);
+    }
+    bool requestLock(int tid, int did, LockMode mode = LockMode::Exclusive) {
+        Trace trace;
+        return requestLock(tid, did, mode, trace);
+    }
+    // Locks every item of `dids` in `mode`, or none of them. The items are
+    // sorted and deduplicated and validated together, and their ancestors'
+    // intention locks are merged in. If all can be granted at once they are,
+    // in one step. Otherwise a blocking manager takes them in ascending DID
+    // order, waiting on one item at a time, and undoes what the call took if
+    // it fails; a non-blocking one refuses the batch without queueing. The
+    // order also satisfies lock-ordering prevention by construction.
+    bool requestLocks(int tid, const std::vector<int>& dids, LockMode mode, std::string& log);
+    bool requestLocks(int tid, const std::vector<int>& dids, LockMode mode = LockMode::Exclusive) {
+        Trace trace;
+        return requestLocks(tid, dids, mode, trace);
+    }
+    // Requests a lock without ever blocking the caller, for event loops.
+    // `done` runs exactly once: on the calling thread if the outcome is known
+    // at once, otherwise on the manager's async thread, which also continues
+    // with the item once its ancestors' intention locks are granted. Keep it
+    // short and never block in it, e.g. post the outcome to the caller's
+    // loop. A zero timeout waits until granted, refused or aborted. The
+    // transaction should not make other requests until it completes.
+    // Requests still pending when the manager is destroyed never complete;
+    // their futures report a broken promise.
+    void requestLockAsync(int tid, int did, LockMode mode, std::chrono::milliseconds timeout,
+                          std::function<void(LockOutcome)> done);
+    std::future<LockOutcome> requestLockAsync(int tid, int did, LockMode mode = LockMode::Exclusive,
+                                              std::chrono::milliseconds timeout = std::chrono::milliseconds::zero());
     void releaseLock(int tid, int did, std::string& log);
+    void releaseLock(int tid, int did) {
+        Trace trace;
+        releaseLock(tid, did, trace);
+    }
     bool detectDeadlock(std::string& log, std::vector<int>& cycle);
+    bool detectDeadlock(std::vector<int>& cycle) {
+        Trace trace;
+        return detectDeadlock(trace, cycle);
+    }
     void recover(const std::vector<int>& cycle, std::string& log);
-    void setPreventionEnabled(bool enabled) { preventionEnabled = enabled; }
-    const std::vector<Transaction>& getTransactions() const { return transactions; }
-    const std::vector<int>& getDataItems() const { return dataItems; }
-    const std::map<int, int>& getLockTable() const { return lockTable; }
+    void recover(const std::vector<int>& cycle) {
+        Trace trace;
+        recover(cycle, trace);
+    }
+    // Reports every deadlocked group in one linear pass over the wait-for graph.
+    bool detectAllDeadlocks(std::string& log, std::vector<std::vector<int>>& components);
+    bool detectAllDeadlocks(std::vector<std::vector<int>>& components) {
+        Trace trace;
+        return detectAllDeadlocks(trace, components);
+    }
+    // Breaks all given groups at once with a small set of victims.
+    void recoverAll(const std::vector<std::vector<int>>& components, std::string& log, std::vector<int>& victims);
+    void recoverAll(const std::vector<std::vector<int>>& components, std::string& log) {
+        std::vector<int> victims;
+        recoverAll(components, log, victims);
+    }
+    void recoverAll(const std::vector<std::vector<int>>& components, std::vector<int>& victims) {
+        Trace trace;
+        recoverAll(components, trace, victims);
+    }
+    // Brings a terminated transaction back with no locks. It keeps its start
+    // timestamp and abort count, so it gains priority each time it is aborted.
+    bool restartTransaction(int tid, std::string& log);
+    bool restartTransaction(int tid) {
+        Trace trace;
+        return restartTransaction(tid, trace);
+    }
+    // Terminates `tid` as a deadlock victim chosen elsewhere, e.g. by a
+    // coordinator that merges the wait-for graphs of several managers.
+    // Returns false if it was not active.
+    bool terminateVictim(int tid, std::string& log);
+    bool terminateVictim(int tid) {
+        Trace trace;
+        return terminateVictim(tid, trace);
+    }
+    // Copies the current wait-for edges as TIDs, sorted. Takes the registry
+    // shared, so it may run alongside lock traffic but waits for transactions
+    // to begin or end.
+    void waitForEdges(std::vector<std::pair<int, int>>& edges);
+    // Ring of recent events; off until its level is lowered.
+    EventLog& events() { return eventLog; }
+    // Counters, wait and detection histograms, and the `hottest` items by
+    // number of requests that waited. Takes the registry shared, so it only
+    // waits for tables to grow, not for lock traffic.
+    void snapshotMetrics(MetricsSnapshot& snapshot, int hottest = 10);
+    // Requests currently queued on any item, read without locking.
+    long blockedRequestCount() const { return queuedRequests; }
+    // Earliest time a cycle through any member of `component` was closed,
+    // as seen by the online check. Returns false if none was recorded.
+    bool deadlockFormedAt(const std::vector<int>& component, std::chrono::steady_clock::time_point& formed);
+    void setPreventionMode(PreventionMode mode) { preventionMode = mode; }
+    void setPreventionEnabled(bool enabled) {
+        setPreventionMode(enabled ? PreventionMode::LockOrdering : PreventionMode::None);
+    }
+    PreventionMode getPreventionMode() const { return preventionMode; }
+    void setVictimPolicy(VictimPolicy policy) { victimPolicy = policy; }
+    void setVictimWeights(const VictimWeights& weights) { victimWeights = weights; }
+    void setStarvationLimit(int aborts) { starvationLimit = aborts; }
+    // Escalate once a transaction holds this many locks directly below one
+    // parent; 0 (the default) never escalates.
+    void setEscalationThreshold(int locks) { escalationThreshold = locks; }
+    int getEscalationThreshold() const { return escalationThreshold; }
+    // In blocking mode a request on an unavailable item parks the calling
+    // thread until a release grants it. It returns false if the transaction
+    // is terminated or the wait would close a deadlock cycle.
+    void setBlocking(bool enabled) { blocking = enabled; }
+    // With online resolution off, blocking requests that close a cycle stay
+    // parked until detection (e.g. a DeadlockDetector) terminates a victim.
+    void setOnlineResolution(bool enabled) { onlineResolution = enabled; }
+    // Transaction slots and data items whose displayed state (status, held
+    // and awaited locks, holders) changed since the previous call, sorted,
+    // plus the current counts so observers can append new rows.
+    struct ChangeSet {
+        int transactionCount = 0;
+        int dataItemCount = 0;
+        std::vector<int> transactions;
+        std::vector<int> dataItems;
+    };
+    void takeChanges(ChangeSet& changes);
+    // The accessors below read live state without locking; only use them
+    // while no other thread is calling into the manager.
+    // Transaction slots, used or free; a table of transactions has one row
+    // per slot. Only as many exist as transactions ever ran at once.
+    int transactionCount() const { return static_cast<int>(txTid.size()); }
+    int transactionAt(int slot) const { return txTid[slot]; } // -1 while the slot is free
+    bool isActive(int tid) const { return validTransaction(tid); }
+    int abortCount(int tid) const { return txAborts[slotOf(tid)]; }
+    const IdSet& heldLocks(int tid) const { return txHeld[slotOf(tid)]; }
+    const IdSet& waitingFor(int tid) const { return txWaiting[slotOf(tid)]; }
+    int dataItemCount() const { return nextDid; }
+    const IdSet& lockHolders(int did) const { return itemHolders[did]; }
+    LockMode lockMode(int did) const { return itemMode[did]; }
+    LockMode heldMode(int tid, int did) const; // `tid` must be a holder of `did`
+    int parentOf(int did) const { return itemParent[did]; }
+    // Nodes are transaction slots; see transactionAt.
+    const WaitForGraph& getWaitForGraph() const { return waitForGraph; }
 };
 
 #endif // LOCKMANAGER_H
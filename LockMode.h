@@ -0,0 +1,70 @@
+#ifndef LOCKMODE_H
+#define LOCKMODE_H
+
+// Shared and Exclusive lock an item itself. The intention modes lock a parent
+// in the item hierarchy and announce finer locks below it: IS for shared
+// locks, IX for any kind, and SIX reads the whole subtree while intending to
+// write parts of it.
+enum class LockMode { Shared, Exclusive, IntentionShared, IntentionExclusive, SharedIntentionExclusive };
+
+// Compatibility matrix: a request is granted only if its mode is compatible
+// with every mode currently held on the item by other transactions.
+inline bool lockModesCompatible(LockMode held, LockMode requested) {
+    static const bool kCompatible[5][5] = {
+        //              S      X     IS     IX    SIX    (requested)
+        /* S   */ {  true, false,  true, false, false },
+        /* X   */ { false, false, false, false, false },
+        /* IS  */ {  true, false,  true,  true,  true },
+        /* IX  */ { false, false,  true,  true, false },
+        /* SIX */ { false, false,  true, false, false },
+    };
+    return kCompatible[static_cast<int>(held)][static_cast<int>(requested)];
+}
+
+// Weakest mode at least as strong as both, e.g. S and IX give SIX. It is
+// what a holder of `a` converts to when it asks for `b`, and the group mode
+// of an item held in `a` and `b`: a request is compatible with the group
+// mode exactly when it is compatible with every holder.
+inline LockMode lockModeSupremum(LockMode a, LockMode b) {
+    const LockMode S = LockMode::Shared, X = LockMode::Exclusive, IS = LockMode::IntentionShared,
+                   IX = LockMode::IntentionExclusive, SIX = LockMode::SharedIntentionExclusive;
+    static const LockMode kSupremum[5][5] = {
+        //            S    X   IS   IX  SIX
+        /* S   */ {   S,   X,   S, SIX, SIX },
+        /* X   */ {   X,   X,   X,   X,   X },
+        /* IS  */ {   S,   X,  IS,  IX, SIX },
+        /* IX  */ { SIX,   X,  IX,  IX, SIX },
+        /* SIX */ { SIX,   X, SIX, SIX, SIX },
+    };
+    return kSupremum[static_cast<int>(a)][static_cast<int>(b)];
+}
+
+// True if holding `held` already grants everything `requested` would.
+inline bool lockModeCovers(LockMode held, LockMode requested) {
+    return lockModeSupremum(held, requested) == held;
+}
+
+// True if `held` on an ancestor implicitly grants `requested` on every item
+// below it: X covers the subtree, S and SIX cover reads.
+inline bool lockModeCoversDescendants(LockMode held, LockMode requested) {
+    if (held == LockMode::Exclusive) return true;
+    bool reads = requested == LockMode::Shared || requested == LockMode::IntentionShared;
+    return reads && (held == LockMode::Shared || held == LockMode::SharedIntentionExclusive);
+}
+
+// Mode a request for `mode` needs on each ancestor of its item.
+inline LockMode intentionFor(LockMode mode) {
+    return mode == LockMode::Shared || mode == LockMode::IntentionShared ? LockMode::IntentionShared
+                                                                           : LockMode::IntentionExclusive;
+}
+
+inline bool isIntentionMode(LockMode mode) {
+    return mode == LockMode::IntentionShared || mode == LockMode::IntentionExclusive;
+}
+
+inline const char* lockModeName(LockMode mode) {
+    static const char* const kNames[] = {"S", "X", "IS", "IX", "SIX"};
+    return kNames[static_cast<int>(mode)];
+}
+
+#endif // LOCKMODE_H
@@ -0,0 +1,115 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class Counter {
+    Requests,         // requestLock calls
+    Granted,          // granted without waiting
+    Waited,           // queued behind a conflicting holder or request
+    GrantedAfterWait, // queued requests granted later
+    Released,
+    OrderingDenials,  // refused by lock ordering
+    WaitDieAborts,
+    Wounds,           // transactions aborted by wound-wait
+    DeadlocksFormed,  // cycles closed, as seen by the online check
+    DeadlocksDetected,
+    Victims,          // transactions terminated by recovery
+    DetectionPasses,
+    Escalations,      // item locks replaced by one lock on their parent
+    Timeouts,         // asynchronous requests withdrawn at their deadline
+    UnsafeDeferrals,  // grants held back by avoidance as unsafe
+    Commits,
+    Aborts,           // transactions ended by abortTransaction
+    kCount
+};
+
+const char* counterName(Counter counter);
+
+// Log-linear histogram in the style of HdrHistogram: 16 linear sub-buckets
+// per power of two, so a recorded value is reported within 1/16 of itself.
+// Values from 0 to 2^48 are tracked; larger ones land in the last bucket.
+class Histogram {
+public:
+    static const int kSubBucketBits = 4;
+    static const int kSubBuckets = 1 << kSubBucketBits;
+    static const int kBuckets = (48 - kSubBucketBits + 1) * kSubBuckets;
+
+    Histogram();
+    void record(std::uint64_t value);
+    static int bucketOf(std::uint64_t value);
+    // Largest value that maps to `bucket`.
+    static std::uint64_t bucketLimit(int bucket);
+
+private:
+    friend struct HistogramSnapshot;
+    std::atomic<std::uint64_t> buckets[kBuckets];
+    std::atomic<std::uint64_t> count;
+    std::atomic<std::uint64_t> sum;
+    std::atomic<std::uint64_t> max;
+};
+
+struct HistogramSnapshot {
+    std::vector<std::uint64_t> buckets;
+    std::uint64_t count = 0;
+    std::uint64_t sum = 0;
+    std::uint64_t max = 0;
+
+    void merge(const Histogram& histogram);
+    double mean() const { return count ? static_cast<double>(sum) / count : 0; }
+    // Smallest bucket limit at or above `fraction` of the samples, capped at max.
+    std::uint64_t percentile(double fraction) const;
+};
+
+struct MetricsSnapshot {
+    std::uint64_t counters[static_cast<int>(Counter::kCount)] = {};
+    HistogramSnapshot waitNs;      // queued to granted
+    HistogramSnapshot detectionNs; // time inside the graph search of one detection call
+    HistogramSnapshot cycleLength; // transactions per cycle or deadlocked group
+    HistogramSnapshot cycleCheckNs; // online search for cycles closed by one change to an item's waits
+    std::vector<std::pair<int, std::uint64_t>> hotItems; // (DID, requests that waited), busiest first
+
+    std::uint64_t operator[](Counter counter) const { return counters[static_cast<int>(counter)]; }
+};
+
+// Counters and histograms striped over shards so threads rarely share a
+// cache line; a thread keeps the shard it first drew. Updates are relaxed
+// atomic adds and a snapshot sums the shards without stopping writers.
+class LockMetrics {
+private:
+    static const int kShards = 16;
+    struct alignas(64) Shard {
+        std::atomic<std::uint64_t> counters[static_cast<int>(Counter::kCount)];
+        Histogram waitNs;
+        Histogram detectionNs;
+        Histogram cycleLength;
+        Histogram cycleCheckNs;
+        Shard();
+    };
+    Shard shards[kShards];
+
+    Shard& local();
+
+public:
+    void add(Counter counter, std::uint64_t amount = 1) {
+        local().counters[static_cast<int>(counter)].fetch_add(amount, std::memory_order_relaxed);
+    }
+    void recordWait(std::uint64_t ns) { local().waitNs.record(ns); }
+    void recordDetection(std::uint64_t ns) { local().detectionNs.record(ns); }
+    void recordCycle(std::uint64_t length) { local().cycleLength.record(length); }
+    void recordCycleCheck(std::uint64_t ns) { local().cycleCheckNs.record(ns); }
+    // Fills everything but hotItems.
+    void snapshot(MetricsSnapshot& snapshot) const;
+};
+
+std::string formatMetricsJson(const MetricsSnapshot& snapshot);
+std::string formatMetricsPrometheus(const MetricsSnapshot& snapshot);
+// Writes JSON when `path` ends in ".json" and Prometheus text otherwise,
+// through a temporary file renamed into place so scrapers never see half.
+bool writeMetrics(const MetricsSnapshot& snapshot, const std::string& path, std::string& log);
+
+#endif // METRICS_H
@@ -10,12 +10,31 @@ TEMPLATE = app
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    bitgraph.cpp \
+    claimgraph.cpp \
+    deadlockdetector.cpp \
+    eventlog.cpp \
+    graphlayout.cpp \
     lockmanager.cpp \
+    locktablemodels.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    metrics.cpp \
+    waitforgraph.cpp
 
 HEADERS += \
+    BitGraph.h \
+    ClaimGraph.h \
+    DeadlockCore.h \
+    DeadlockDetector.h \
+    EventLog.h \
+    GraphLayout.h \
+    IdSet.h \
     LockManager.h \
+    LockMode.h \
+    Metrics.h \
+    WaitForGraph.h \
+    locktablemodels.h \
     mainwindow.h
 
 FORMS += \
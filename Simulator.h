@@ -0,0 +1,133 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <istream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "LockManager.h"
+
+// One lock request of a simulated transaction, after thinking for thinkUs.
+struct SimOp {
+    int item = 0; // DID in the simulated manager, whose items are flat
+    LockMode mode = LockMode::Exclusive;
+    int thinkUs = 0;
+};
+
+struct SimTransaction {
+    std::vector<SimOp> ops;
+};
+
+// Synthetic workload: every transaction locks a set of distinct items drawn
+// with Zipf skew (item popularity falls off as 1 / rank^skew, ranks shuffled
+// over the DIDs), each in X with probability writePercent, then commits.
+struct WorkloadOptions {
+    int transactions = 2000;
+    int items = 64;
+    int minLocks = 2;     // lock-set size, uniform in [minLocks, maxLocks]
+    int maxLocks = 4;
+    double skew = 0;      // 0 is uniform; around 1 gives a few hot items
+    int writePercent = 50;
+    int thinkUs = 0;      // mean think time before each request, exponentially distributed
+    unsigned seed = 1;
+};
+
+// A prevention, detection and victim policy to run a workload under.
+// Online detection refuses the request that closes a cycle as it forms;
+// fixed and adaptive run a DeadlockDetector every intervalMs (adaptive:
+// from 1 ms up to intervalMs) and abort victims chosen by `victim`.
+struct SimPolicy {
+    enum class Detection { Online, Fixed, Adaptive };
+    PreventionMode prevention = PreventionMode::None;
+    Detection detection = Detection::Online;
+    int intervalMs = 10;
+    VictimPolicy victim = VictimPolicy::Youngest;
+
+    // Round-trips through WorkloadSimulator::parsePolicy, e.g. "none/fixed:10/weighted".
+    std::string name() const;
+};
+
+struct SimResult {
+    std::string policy;
+    long transactions = 0;  // in the workload
+    long committed = 0;
+    long aborts = 0;        // attempts that failed and were retried or given up
+    long gaveUp = 0;        // transactions abandoned after maxRetries failed attempts
+    double seconds = 0;
+    double blockedMs = 0;   // total time workers spent inside lock requests
+    double waitP99Us = 0;   // queued-to-granted lock wait
+    long deadlocksFormed = 0;
+    long victims = 0;       // terminated by detection, wait-die or wound-wait
+    double detectionMs = 0;     // wall time in detector passes, including waits for the lock table
+    double detectionCpuMs = 0;  // CPU time the detector used in them
+    double cycleCheckMs = 0;    // online cycle checks, paid under every policy
+
+    double throughput() const { return seconds > 0 ? committed / seconds : 0; }
+    double abortRate() const { return committed + aborts ? static_cast<double>(aborts) / (committed + aborts) : 0; }
+    double blockedMsPerTransaction() const { return committed ? blockedMs / committed : 0; }
+};
+
+// Drives a blocking LockManager with a workload from worker threads, one
+// running transaction each, and measures how a policy copes with it.
+//
+// A failed request aborts the attempt: the transaction gives back what it
+// holds, backs off and starts over with the same TID, keeping its age for
+// wait-die and wound-wait and its abort count for victim selection. Under
+// lock ordering each transaction requests its items in ascending DID order,
+// as code written for that policy must; under avoidance it declares them
+// up front.
+//
+// Traces are CSV, one lock request per line: txn,item,mode[,think_us].
+// Consecutive lines with the same txn form one transaction. Items may be
+// any integers; loading numbers the distinct ones 0, 1, ... in order. Mode
+// is a LockMode name (S, X, IS, IX or SIX). A header line and lines
+// starting with '#' are skipped.
+class WorkloadSimulator {
+private:
+    std::vector<SimTransaction> workload;
+    int items;
+    int concurrency;
+    int maxRetries;
+
+public:
+    explicit WorkloadSimulator(int concurrency = 8, int maxRetries = 1000);
+
+    void generate(const WorkloadOptions& options);
+    bool loadTrace(const std::string& path, std::string& log);
+    bool loadTrace(std::istream& in, std::string& log);
+    bool saveTrace(const std::string& path, std::string& log) const;
+    int transactionCount() const { return static_cast<int>(workload.size()); }
+    int itemCount() const { return items; }
+
+    // Runs the whole workload on a fresh manager under `policy`.
+    SimResult run(const SimPolicy& policy) const;
+
+    // PREVENTION[/DETECTION[/VICTIM]]: none, ordering, wait-die, wound-wait
+    // or avoidance; online, fixed[:MS] or adaptive[:MS]; youngest,
+    // fewest-locks, least-work or weighted.
+    static bool parsePolicy(const std::string& spec, SimPolicy& policy, std::string& log);
+    // Every prevention mode with online detection, then detection without
+    // prevention at a few intervals and with every victim policy.
+    static std::vector<SimPolicy> defaultPolicies();
+    static std::string csvHeader();
+    static std::string csvRow(const SimResult& result);
+};
+
+// Collects committed transactions into a trace, from any number of threads.
+// Whoever drives a transaction notes each lock request it makes itself,
+// with the time since its previous request returned as think time, and
+// adds the transaction once it commits; an aborted attempt is dropped,
+// since the driver runs it again. Unlike the event ring, nothing is lost.
+class TraceRecorder {
+private:
+    mutable std::mutex mutex;
+    std::vector<std::pair<int, SimTransaction>> finished; // (TID, transaction)
+
+public:
+    void add(int tid, SimTransaction transaction);
+    long transactionCount() const;
+    bool save(const std::string& path, std::string& log) const;
+};
+
+#endif // SIMULATOR_H
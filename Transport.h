@@ -0,0 +1,54 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Request/reply channel from a coordinator to numbered nodes. Messages are
+// single lines of text without the trailing newline; each node answers
+// through a handler that maps a request to its reply.
+class Transport {
+public:
+    using Handler = std::function<std::string(const std::string&)>;
+
+    virtual ~Transport() = default;
+    virtual int nodeCount() const = 0;
+    // Sends `request` to `node` and waits for its reply. Returns false with
+    // the reason in `log` if the node could not be reached.
+    virtual bool call(int node, const std::string& request, std::string& reply, std::string& log) = 0;
+};
+
+// Calls the handlers directly on the caller's thread.
+class InProcessTransport : public Transport {
+private:
+    std::vector<Handler> handlers;
+
+public:
+    explicit InProcessTransport(std::vector<Handler> handlers);
+    int nodeCount() const override { return static_cast<int>(handlers.size()); }
+    bool call(int node, const std::string& request, std::string& reply, std::string& log) override;
+};
+
+// Serves each handler from its own thread on a TCP socket bound to
+// 127.0.0.1 with an ephemeral port, and opens one connection per call, so
+// nodes can be exercised through a real network stack on one machine.
+// POSIX sockets only; elsewhere every call fails.
+class LoopbackTransport : public Transport {
+private:
+    struct Listener;
+    std::vector<std::unique_ptr<Listener>> listeners;
+    std::string error;
+
+public:
+    explicit LoopbackTransport(std::vector<Handler> handlers);
+    ~LoopbackTransport() override;
+    // False, with the reason in `log`, if a listener could not be started.
+    bool ready(std::string& log) const;
+    int nodeCount() const override { return static_cast<int>(listeners.size()); }
+    int port(int node) const;
+    bool call(int node, const std::string& request, std::string& reply, std::string& log) override;
+};
+
+#endif // TRANSPORT_H
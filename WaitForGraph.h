@@ -0,0 +1,92 @@
+#ifndef WAITFORGRAPH_H
+#define WAITFORGRAPH_H
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "BitGraph.h"
+
+// Persistent wait-for graph over dense transaction IDs. Edges carry a
+// multiplicity so that a waiter blocked on several items held by the same
+// transaction keeps the edge until the last of those waits goes away.
+//
+// Edges live in adjacency lists. Once a graph of up to BitGraph::kMaxNodes
+// nodes is dense enough (hot spots, where every waiter in a long queue
+// waits for everyone ahead of it), cycle searches switch to a bit matrix
+// copy of it, which is built on first use and then kept up to date.
+class WaitForGraph {
+public:
+    enum class Engine {
+        Auto,   // pick by size and density on each search
+        Lists,  // always walk adjacency lists
+        Matrix  // always use the bit matrix while the graph fits in one
+    };
+
+private:
+    struct Edge {
+        int to;
+        int count;
+    };
+    std::vector<std::vector<Edge>> adj;
+    std::size_t edgeCount;
+    int activeNodes; // one past the highest node given an edge since clear()
+
+    // Scratch state for searches, reused across calls to avoid clearing.
+    mutable std::vector<unsigned> mark;
+    mutable std::vector<int> parent;
+    mutable std::vector<std::pair<int, std::size_t>> dfsStack;
+    mutable unsigned epoch;
+
+    Engine engine;
+    mutable BitGraph matrix;
+    mutable bool matrixBuilt; // mirrors every edge while set
+
+    void reserveNode(int tid);
+    unsigned nextEpoch() const;
+    // Builds the matrix if needed; false when searches should use the lists.
+    bool useMatrix() const;
+
+public:
+    WaitForGraph();
+    // Adds one wait from -> to. Returns true if the edge did not exist before.
+    bool addEdge(int from, int to);
+    void removeEdge(int from, int to);
+    bool hasEdge(int from, int to) const;
+    std::size_t size() const { return edgeCount; }
+    void setEngine(Engine choice) { engine = choice; }
+    Engine getEngine() const { return engine; }
+    // Drops every edge but keeps node storage, so a graph can be rebuilt
+    // repeatedly without allocating. Density and the matrix size then follow
+    // the nodes used from here on, not the largest graph seen before.
+    void clear();
+
+    // Online check for a freshly added edge from -> to: searches only the part
+    // of the graph reachable from `to`. Returns the cycle as
+    // [from, to, ..., from], or an empty vector.
+    std::vector<int> findCycleThrough(int from, int to) const;
+    // Full search; returns the first cycle found as [t, ..., t] or empty.
+    std::vector<int> findCycle() const;
+    // Same search without building the cycle; uses only scratch storage.
+    bool hasCycle() const;
+    // Every deadlocked group at once: strongly connected components with more
+    // than one member, found in a single linear pass (Tarjan). Members of
+    // each component are sorted by node ID.
+    std::vector<std::vector<int>> deadlockedComponents() const;
+    // Greedy feedback vertex set: picks victims whose removal leaves every
+    // given component acyclic, the lowest victimCost first, so a victim
+    // policy and any penalty for starving nodes always hold. Among equal
+    // costs it prefers nodes with the most waits in and out, then the
+    // youngest by `age` (the highest value), then the highest node ID. Node
+    // IDs need not follow age, e.g. when they are reused slots, so pass `age`
+    // for a tie-break that means something.
+    std::vector<int> breakingSet(const std::vector<std::vector<int>>& components,
+                                 const std::function<double(int)>& victimCost,
+                                 const std::function<long(int)>& age = nullptr) const;
+    // Successor list of `tid` (targets only, without multiplicities).
+    std::vector<int> successors(int tid) const;
+    // Every edge once, as (from, to) sorted by source.
+    std::vector<std::pair<int, int>> edges() const;
+};
+
+#endif // WAITFORGRAPH_H
@@ -0,0 +1,274 @@
+#include "BatchClassifier.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "Metrics.h"
+
+namespace {
+
+// Rows are copied into one buffer per batch; batches are recycled between
+// the reader and the workers so their buffers stop growing after warm-up.
+struct Batch {
+    std::string text;
+    std::vector<std::pair<std::size_t, std::size_t>> rows; // offset, length
+};
+
+struct WorkerResult {
+    BatchReport counts;
+    const char* firstError = nullptr;
+    Histogram latencyNs; // fixed size, however many rows
+};
+
+class BatchQueue {
+private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<Batch*> filled;
+    std::deque<Batch*> empty;
+    bool finished = false;
+
+public:
+    explicit BatchQueue(const std::vector<std::unique_ptr<Batch>>& pool) {
+        for (const auto& batch : pool) empty.push_back(batch.get());
+    }
+    Batch* takeEmpty() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return !empty.empty(); });
+        Batch* batch = empty.front();
+        empty.pop_front();
+        return batch;
+    }
+    void putFilled(Batch* batch) {
+        std::lock_guard<std::mutex> lock(mutex);
+        filled.push_back(batch);
+        changed.notify_all();
+    }
+    // Returns nullptr once the input is finished and drained
+    Batch* takeFilled() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return !filled.empty() || finished; });
+        if (filled.empty()) return nullptr;
+        Batch* batch = filled.front();
+        filled.pop_front();
+        return batch;
+    }
+    void putEmpty(Batch* batch) {
+        std::lock_guard<std::mutex> lock(mutex);
+        empty.push_back(batch);
+        changed.notify_all();
+    }
+    void finish() {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        changed.notify_all();
+    }
+};
+
+void skipSpaces(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+}
+
+// Reads a quoted node name such as 'P5' or "R12"
+bool readNode(const char*& p, const char* end, char& kind, int& id, const char*& error) {
+    skipSpaces(p, end);
+    if (p >= end || (*p != '\'' && *p != '"')) return false;
+    char quote = *p++;
+    if (p >= end || (*p != 'P' && *p != 'R')) return false;
+    kind = *p++;
+    if (p >= end || *p < '0' || *p > '9') return false;
+    id = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        // Checked per digit, so a long run of digits cannot overflow
+        id = id * 10 + (*p++ - '0');
+        if (id > BatchClassifier::kMaxNodeId) {
+            error = "node number above 65535";
+            return false;
+        }
+    }
+    if (p >= end || *p != quote) return false;
+    ++p;
+    return true;
+}
+
+} // namespace
+
+BatchClassifier::BatchClassifier(int threads, int batchRows)
+    : threads(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+      batchRows(std::max(1, batchRows)), engine(WaitForGraph::Engine::Auto) {}
+
+bool BatchClassifier::classifyRow(const char* begin, const char* end, Arena& arena, bool& deadlocked,
+                                  int& label) {
+    arena.requests.clear();
+    arena.allocations.clear();
+    arena.error = "malformed edge list";
+    const char* p = std::find(begin, end, '[');
+    if (p == end) return false;
+    ++p;
+    for (;;) {
+        skipSpaces(p, end);
+        if (p < end && *p == ',') {
+            ++p;
+            skipSpaces(p, end);
+        }
+        if (p >= end) return false;
+        if (*p == ']') break;
+        if (*p != '(') return false;
+        ++p;
+        char fromKind, toKind;
+        int from, to;
+        if (!readNode(p, end, fromKind, from, arena.error)) return false;
+        skipSpaces(p, end);
+        if (p >= end || *p != ',') return false;
+        ++p;
+        if (!readNode(p, end, toKind, to, arena.error)) return false;
+        skipSpaces(p, end);
+        if (p >= end || *p != ')' || fromKind == toKind) return false;
+        ++p;
+        if (fromKind == 'P') {
+            arena.requests.push_back({from, to});
+        } else {
+            arena.allocations.push_back({from, to});
+        }
+    }
+
+    arena.error = nullptr;
+
+    // Label: the field after the last comma, if it is a bare 0 or 1
+    label = -1;
+    const char* comma = end;
+    for (const char* q = end; q > p; --q) {
+        if (q[-1] == ',') {
+            comma = q;
+            break;
+        }
+    }
+    if (comma != end) {
+        const char* q = comma;
+        skipSpaces(q, end);
+        const char* last = end;
+        while (last > q && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r')) --last;
+        if (last - q == 1 && (*q == '0' || *q == '1')) label = *q - '0';
+    }
+
+    // A request on R waits for every process holding an instance of R
+    std::sort(arena.allocations.begin(), arena.allocations.end());
+    arena.graph.clear();
+    for (const auto& request : arena.requests) {
+        auto first = std::lower_bound(arena.allocations.begin(), arena.allocations.end(),
+                                      std::make_pair(request.second, -1));
+        for (auto it = first; it != arena.allocations.end() && it->first == request.second; ++it) {
+            arena.graph.addEdge(request.first, it->second);
+        }
+    }
+    deadlocked = arena.graph.hasCycle();
+    return true;
+}
+
+bool BatchClassifier::classifyFile(const std::string& path, BatchReport& report, std::string& log) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        log = "Cannot open " + path;
+        return false;
+    }
+    return classifyStream(in, report, log);
+}
+
+bool BatchClassifier::classifyStream(std::istream& in, BatchReport& report, std::string& log) {
+    auto began = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<Batch>> pool;
+    for (int i = 0; i < threads * 2; ++i) pool.emplace_back(new Batch);
+    BatchQueue queue(pool);
+    std::vector<WorkerResult> results(threads);
+    std::vector<std::thread> workers;
+    for (int w = 0; w < threads; ++w) {
+        workers.emplace_back([&, w] {
+            Arena arena;
+            arena.graph.setEngine(engine);
+            WorkerResult& result = results[w];
+            while (Batch* batch = queue.takeFilled()) {
+                for (const auto& row : batch->rows) {
+                    auto rowBegan = std::chrono::steady_clock::now();
+                    const char* text = batch->text.data() + row.first;
+                    bool deadlocked;
+                    int label;
+                    if (!classifyRow(text, text + row.second, arena, deadlocked, label)) {
+                        ++result.counts.skipped;
+                        if (!result.firstError) result.firstError = arena.error;
+                        continue;
+                    }
+                    result.latencyNs.record(static_cast<std::uint64_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - rowBegan)
+                            .count()));
+                    ++result.counts.graphs;
+                    if (label == -1) ++result.counts.unlabeled;
+                    else if (deadlocked && label) ++result.counts.truePositive;
+                    else if (deadlocked) ++result.counts.falsePositive;
+                    else if (label) ++result.counts.falseNegative;
+                    else ++result.counts.trueNegative;
+                }
+                queue.putEmpty(batch);
+            }
+        });
+    }
+
+    std::string line;
+    bool first = true;
+    Batch* batch = nullptr;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (first) {
+            first = false;
+            if (line.compare(0, 5, "Graph") == 0) continue; // header
+        }
+        if (line.empty()) continue;
+        if (!batch) {
+            batch = queue.takeEmpty();
+            batch->text.clear();
+            batch->rows.clear();
+        }
+        batch->rows.push_back({batch->text.size(), line.size()});
+        batch->text += line;
+        if (static_cast<int>(batch->rows.size()) == batchRows) {
+            queue.putFilled(batch);
+            batch = nullptr;
+        }
+    }
+    if (batch) queue.putFilled(batch);
+    queue.finish();
+    for (auto& worker : workers) worker.join();
+
+    report = BatchReport();
+    HistogramSnapshot latencies;
+    const char* firstError = nullptr;
+    for (auto& result : results) {
+        if (!firstError) firstError = result.firstError;
+        report.graphs += result.counts.graphs;
+        report.skipped += result.counts.skipped;
+        report.unlabeled += result.counts.unlabeled;
+        report.truePositive += result.counts.truePositive;
+        report.falsePositive += result.counts.falsePositive;
+        report.trueNegative += result.counts.trueNegative;
+        report.falseNegative += result.counts.falseNegative;
+        latencies.merge(result.latencyNs);
+    }
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+    report.p50Us = latencies.percentile(0.50) / 1e3;
+    report.p90Us = latencies.percentile(0.90) / 1e3;
+    report.p99Us = latencies.percentile(0.99) / 1e3;
+    report.maxUs = latencies.max / 1e3;
+    log = "Classified " + std::to_string(report.graphs) + " graph(s) on " + std::to_string(threads) + " thread(s)";
+    if (report.skipped) {
+        log += ", skipped " + std::to_string(report.skipped) + " malformed row(s)";
+        if (firstError) log += " (" + std::string(firstError) + ")";
+    }
+    if (in.bad()) {
+        log += "; read error";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,155 @@
+#include "BitGraph.h"
+#include <algorithm>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit; `bits` must not be zero.
+static int lowestBit(std::uint64_t bits) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+BitGraph::BitGraph() : words(0), count(0) {}
+
+bool BitGraph::reserve(int nodes) {
+    if (nodes <= count) return true;
+    if (nodes > kMaxNodes) {
+        release();
+        return false;
+    }
+    std::size_t needed = (static_cast<std::size_t>(nodes) + 63) / 64;
+    if (count == 0) {
+        // Nothing to keep, so size the rows exactly, reusing old storage
+        rows.assign(static_cast<std::size_t>(nodes) * needed, 0);
+        words = needed;
+    } else if (needed > words) {
+        // Rows get wider: lay the matrix out again, doubling so growing one
+        // node at a time does not copy it every time
+        std::size_t wider = std::max(needed, std::min(words * 2, std::size_t(kMaxNodes / 64)));
+        std::vector<std::uint64_t> grown(static_cast<std::size_t>(nodes) * wider, 0);
+        for (int v = 0; v < count; ++v) std::copy(row(v), row(v) + words, grown.begin() + v * wider);
+        rows.swap(grown);
+        words = wider;
+    } else {
+        rows.resize(static_cast<std::size_t>(nodes) * words, 0);
+    }
+    count = nodes;
+    unvisited.assign(words, 0);
+    onPath.assign(words, 0);
+    return true;
+}
+
+void BitGraph::release() {
+    std::vector<std::uint64_t>().swap(rows);
+    words = 0;
+    count = 0;
+}
+
+void BitGraph::clear() {
+    rows.clear();
+    words = 0;
+    count = 0;
+}
+
+void BitGraph::clearRow(int node) {
+    std::fill(rows.begin() + node * words, rows.begin() + (node + 1) * words, 0);
+}
+
+void BitGraph::resetMarks() const {
+    std::fill(unvisited.begin(), unvisited.end(), ~std::uint64_t(0));
+    if (count % 64) unvisited[count / 64] = (std::uint64_t(1) << (count % 64)) - 1;
+    std::fill(unvisited.begin() + (count + 63) / 64, unvisited.end(), 0);
+    std::fill(onPath.begin(), onPath.end(), 0);
+    stack.clear();
+}
+
+int BitGraph::push(int node) const {
+    unvisited[node / 64] &= ~(std::uint64_t(1) << (node % 64));
+    onPath[node / 64] |= std::uint64_t(1) << (node % 64);
+    stack.push_back({node, 0});
+    // Only nodes already on the path when `node` is pushed can be its
+    // ancestors, so one test here finds every back edge out of it
+    const std::uint64_t* out = row(node);
+    for (std::size_t w = 0; w < words; ++w) {
+        std::uint64_t back = out[w] & onPath[w];
+        if (back) return static_cast<int>(w * 64) + lowestBit(back);
+    }
+    return -1;
+}
+
+int BitGraph::nextChild() const {
+    auto& top = stack.back();
+    const std::uint64_t* out = row(top.first);
+    for (std::size_t w = top.second; w < words; ++w) {
+        std::uint64_t fresh = out[w] & unvisited[w];
+        if (fresh) {
+            top.second = w; // the child is marked visited, so rescanning this word is safe
+            return static_cast<int>(w * 64) + lowestBit(fresh);
+        }
+    }
+    top.second = words;
+    return -1;
+}
+
+std::vector<int> BitGraph::findPath(int from, int to) const {
+    if (std::max(from, to) >= count) return {};
+    resetMarks();
+    // Depth-first from `from`; the path is the search stack once a node on
+    // it has an edge to `to`
+    push(from);
+    for (;;) {
+        int node = stack.back().first;
+        if (test(node, to)) {
+            std::vector<int> path;
+            path.reserve(stack.size() + 1);
+            for (const auto& frame : stack) path.push_back(frame.first);
+            path.push_back(to);
+            return path;
+        }
+        int child = nextChild();
+        if (child != -1) {
+            push(child);
+            continue;
+        }
+        onPath[node / 64] &= ~(std::uint64_t(1) << (node % 64));
+        stack.pop_back();
+        if (stack.empty()) return {};
+    }
+}
+
+std::vector<int> BitGraph::findCycle() const {
+    resetMarks();
+    for (int root = 0; root < count; ++root) {
+        if (!((unvisited[root / 64] >> (root % 64)) & 1)) continue;
+        int ancestor = push(root);
+        while (ancestor == -1) {
+            int child = nextChild();
+            if (child != -1) {
+                ancestor = push(child);
+                continue;
+            }
+            int node = stack.back().first;
+            onPath[node / 64] &= ~(std::uint64_t(1) << (node % 64));
+            stack.pop_back();
+            if (stack.empty()) break;
+        }
+        if (ancestor == -1) continue;
+        std::vector<int> cycle;
+        auto start = std::find_if(stack.begin(), stack.end(),
+                                  [ancestor](const std::pair<int, std::size_t>& f) { return f.first == ancestor; });
+        for (auto it = start; it != stack.end(); ++it) cycle.push_back(it->first);
+        cycle.push_back(ancestor);
+        return cycle;
+    }
+    return {};
+}
+
+bool BitGraph::hasCycle() const {
+    return !findCycle().empty();
+}
@@ -0,0 +1,175 @@
+#include "ClaimGraph.h"
+#include <algorithm>
+
+ClaimGraph::ClaimGraph() : ordered(true), edgeCount(0), epoch(0) {}
+
+void ClaimGraph::reserveNode(int node) {
+    // New nodes have no edges, so the end of the order is as good as any place
+    while (static_cast<int>(out.size()) <= node) {
+        order.push_back(static_cast<int>(out.size()));
+        out.emplace_back();
+        in.emplace_back();
+        mark.push_back(0);
+    }
+}
+
+unsigned ClaimGraph::nextEpoch() {
+    if (++epoch == 0) { // Wrapped around: stale marks could alias the new epoch
+        std::fill(mark.begin(), mark.end(), 0);
+        epoch = 1;
+    }
+    return epoch;
+}
+
+void ClaimGraph::addEdge(int from, int to) {
+    reserveNode(std::max(from, to));
+    for (auto& e : out[from]) {
+        if (e.node == to) {
+            ++e.count;
+            for (auto& r : in[to]) {
+                if (r.node == from) ++r.count;
+            }
+            return;
+        }
+    }
+    out[from].push_back({to, 1});
+    in[to].push_back({from, 1});
+    ++edgeCount;
+    if (ordered && order[from] > order[to]) reorder(from, to);
+}
+
+void ClaimGraph::removeEdge(int from, int to) {
+    if (std::max(from, to) >= static_cast<int>(out.size())) return;
+    // Dropping an edge never invalidates a topological order
+    auto drop = [](std::vector<Edge>& edges, int node) {
+        for (size_t i = 0; i < edges.size(); ++i) {
+            if (edges[i].node != node) continue;
+            if (--edges[i].count > 0) return false;
+            edges[i] = edges.back();
+            edges.pop_back();
+            return true;
+        }
+        return false;
+    };
+    drop(in[to], from);
+    if (drop(out[from], to)) --edgeCount;
+}
+
+void ClaimGraph::reorder(int from, int to) {
+    int lower = order[to], upper = order[from];
+    // Nodes reachable from `to` that are ordered before `from`...
+    unsigned ep = nextEpoch();
+    forward.clear();
+    stack.assign(1, to);
+    mark[to] = ep;
+    while (!stack.empty()) {
+        int node = stack.back();
+        stack.pop_back();
+        forward.push_back(node);
+        for (const auto& e : out[node]) {
+            if (e.node == from) {
+                ordered = false; // the edge closed a cycle
+                return;
+            }
+            if (mark[e.node] == ep || order[e.node] > upper) continue;
+            mark[e.node] = ep;
+            stack.push_back(e.node);
+        }
+    }
+    // ...and nodes reaching `from` that are ordered after `to`
+    backward.clear();
+    stack.assign(1, from);
+    mark[from] = ep;
+    while (!stack.empty()) {
+        int node = stack.back();
+        stack.pop_back();
+        backward.push_back(node);
+        for (const auto& e : in[node]) {
+            if (mark[e.node] == ep || order[e.node] < lower) continue;
+            mark[e.node] = ep;
+            stack.push_back(e.node);
+        }
+    }
+    // The second group moves ahead of the first within the positions they use
+    auto byOrder = [this](int a, int b) { return order[a] < order[b]; };
+    std::sort(forward.begin(), forward.end(), byOrder);
+    std::sort(backward.begin(), backward.end(), byOrder);
+    std::vector<int> positions;
+    positions.reserve(forward.size() + backward.size());
+    for (int node : backward) positions.push_back(order[node]);
+    for (int node : forward) positions.push_back(order[node]);
+    std::sort(positions.begin(), positions.end());
+    size_t i = 0;
+    for (int node : backward) order[node] = positions[i++];
+    for (int node : forward) order[node] = positions[i++];
+}
+
+bool ClaimGraph::rebuildOrder() {
+    // Kahn's algorithm
+    std::vector<int> indegree(out.size(), 0);
+    for (const auto& edges : out) {
+        for (const auto& e : edges) ++indegree[e.node];
+    }
+    stack.clear();
+    for (int node = 0; node < static_cast<int>(out.size()); ++node) {
+        if (indegree[node] == 0) stack.push_back(node);
+    }
+    int next = 0;
+    while (!stack.empty()) {
+        int node = stack.back();
+        stack.pop_back();
+        order[node] = next++;
+        for (const auto& e : out[node]) {
+            if (--indegree[e.node] == 0) stack.push_back(e.node);
+        }
+    }
+    if (next != static_cast<int>(out.size())) {
+        // Keep `order` a permutation for when the cycle goes away
+        for (int node = 0; node < static_cast<int>(out.size()); ++node) order[node] = node;
+        return false;
+    }
+    ordered = true;
+    return true;
+}
+
+int ClaimGraph::reachedSource(int to, const std::vector<int>& sources) {
+    if (to >= static_cast<int>(out.size())) return -1; // no edges yet
+    if (!ordered && !rebuildOrder()) {
+        // Already cyclic (avoidance was off for a while): plain search
+        unsigned ep = nextEpoch();
+        stack.assign(1, to);
+        mark[to] = ep;
+        while (!stack.empty()) {
+            int node = stack.back();
+            stack.pop_back();
+            for (const auto& e : out[node]) {
+                if (mark[e.node] == ep) continue;
+                if (std::binary_search(sources.begin(), sources.end(), e.node)) return e.node;
+                mark[e.node] = ep;
+                stack.push_back(e.node);
+            }
+        }
+        return -1;
+    }
+    // Everything `to` reaches comes after it in the order, so only sources
+    // after it can be reached, and only nodes up to the last of them matter
+    int bound = -1;
+    for (int s : sources) {
+        if (s < static_cast<int>(out.size()) && order[s] > order[to]) bound = std::max(bound, order[s]);
+    }
+    if (bound == -1) return -1;
+    unsigned ep = nextEpoch();
+    stack.assign(1, to);
+    mark[to] = ep;
+    while (!stack.empty()) {
+        int node = stack.back();
+        stack.pop_back();
+        for (const auto& e : out[node]) {
+            if (mark[e.node] == ep || order[e.node] > bound) continue;
+            if (std::binary_search(sources.begin(), sources.end(), e.node)) return e.node;
+            mark[e.node] = ep;
+            stack.push_back(e.node);
+        }
+    }
+    return -1;
+}
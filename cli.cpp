@@ -0,0 +1,710 @@
+#include "DeadlockCore.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+static void usage() {
+    std::cerr << "usage: deadlock-cli <command> [options]\n"
+                 "\n"
+                 "commands:\n"
+                 "  demo    two transactions deadlock; detect and recover\n"
+                 "  stress  threads lock random item pairs in blocking mode\n"
+                 "  cluster threads lock random item pairs across shards with a global detector\n"
+                 "  classify FILE... [--threads N] [--engine auto|lists|matrix]\n"
+                 "          check labelled resource-allocation graphs (deadlock_dataset.csv format);\n"
+                 "          cycles are searched on adjacency lists, on a bit matrix, or on\n"
+                 "          whichever suits each graph's size and density (default auto)\n"
+                 "  simulate run one workload under several policies and print a CSV row for each\n"
+                 "\n"
+                 "stress options:\n"
+                 "  --threads N        worker threads, one transaction each (default 8)\n"
+                 "  --items N          data items (default 32)\n"
+                 "  --ops N            lock pairs per thread (default 20000)\n"
+                 "  --shared PCT       percentage of first locks taken shared (default 0)\n"
+                 "  --prevention MODE  none, ordering, wait-die, wound-wait or avoidance\n"
+                 "                     (default none)\n"
+                 "  --detector MODE    off, fixed or adaptive (default off: cycles are\n"
+                 "                     refused as they form)\n"
+                 "  --interval MS      detector interval, or its upper bound when adaptive (default 10)\n"
+                 "  --seed N           random seed (default 1)\n"
+                 "  --events LEVEL     keep events at LEVEL and above: debug, info, warning,\n"
+                 "                     error or off (default off)\n"
+                 "  --metrics FILE     write a metrics snapshot at the end, as JSON if FILE ends\n"
+                 "                     in .json and as Prometheus text otherwise\n"
+                 "  --tables N         group the items into N tables below one database item\n"
+                 "                     (default 0: a flat set of items)\n"
+                 "  --scan PCT         percentage of operations that lock every item of one\n"
+                 "                     table, then release the table (needs --tables)\n"
+                 "  --escalate N       replace N item locks below one table by a table lock\n"
+                 "                     (default 0: never)\n"
+                 "  --batch on|off     take each pair with one all-or-nothing requestLocks call\n"
+                 "                     in the first lock's mode (default off)\n"
+                 "  --timeout MS       request every lock asynchronously and give up after MS;\n"
+                 "                     without a detector, cycles are left for timeouts to break\n"
+                 "                     (default 0: no timeout)\n"
+                 "  --claims N         each transaction declares N random items up front and\n"
+                 "                     only locks those (default 0: every item; avoidance\n"
+                 "                     needs claims to admit anything)\n"
+                 "  --commit on|off    run every operation as a transaction of its own, begun\n"
+                 "                     before and committed after it, instead of one long-lived\n"
+                 "                     transaction per thread (default off)\n"
+                 "  --trace FILE       record every committed transaction's lock requests as a\n"
+                 "                     trace for simulate (needs --commit on)\n"
+                 "\n"
+                 "cluster options: --threads, --items (spread over the shards), --ops, --shared,\n"
+                 "--interval (global detector period), --seed and --commit as for stress, plus\n"
+                 "  --shards N         lock managers, each owning a DID range (default 4)\n"
+                 "  --transport KIND   inproc or loopback (TCP on 127.0.0.1) (default inproc)\n"
+                 "\n"
+                 "simulate options:\n"
+                 "  --threads N        concurrent transactions (default 8)\n"
+                 "  --transactions N   transactions to generate (default 2000)\n"
+                 "  --items N          data items (default 64)\n"
+                 "  --locks MIN[-MAX]  distinct items each transaction locks (default 2-4)\n"
+                 "  --skew Z           Zipf exponent of item popularity; 0 is uniform (default 0)\n"
+                 "  --writes PCT       percentage of locks taken exclusive (default 50)\n"
+                 "  --think US         mean think time before each lock request (default 0)\n"
+                 "  --seed N           random seed (default 1)\n"
+                 "  --trace FILE       replay a recorded trace instead of generating a workload\n"
+                 "  --record FILE      save the generated workload as a trace\n"
+                 "  --retries N        failed attempts before a transaction is given up\n"
+                 "                     (default 1000)\n"
+                 "  --policy SPEC      PREVENTION[/DETECTION[/VICTIM]], repeatable: none, ordering,\n"
+                 "                     wait-die, wound-wait or avoidance; online, fixed[:MS] or\n"
+                 "                     adaptive[:MS]; youngest, fewest-locks, least-work or weighted\n"
+                 "                     (default: every prevention mode online, fixed detection\n"
+                 "                     at 1, 10 and 100 ms, and adaptive with each victim policy)\n";
+}
+
+static int runDemo() {
+    LockManager manager;
+    std::string log;
+    std::vector<int> cycle;
+    int t0 = manager.addTransaction();
+    int t1 = manager.addTransaction();
+    int d0 = manager.addDataItem();
+    int d1 = manager.addDataItem();
+    manager.requestLock(t0, d0, log);
+    std::cout << log << "\n";
+    manager.requestLock(t1, d1, log);
+    std::cout << log << "\n";
+    manager.requestLock(t0, d1, log);
+    std::cout << log << "\n";
+    manager.requestLock(t1, d0, log);
+    std::cout << log << "\n";
+    if (manager.detectDeadlock(log, cycle)) {
+        std::cout << log << "\n";
+        manager.recover(cycle, log);
+    }
+    std::cout << log << "\n";
+    return 0;
+}
+
+struct StressOptions {
+    int threads = 8;
+    int items = 32;
+    long ops = 20000;
+    int sharedPercent = 0;
+    PreventionMode prevention = PreventionMode::None;
+    std::string detector = "off";
+    int intervalMs = 10;
+    unsigned seed = 1;
+    EventLevel events = EventLevel::Off;
+    std::string metricsPath;
+    int shards = 4;
+    std::string transport = "inproc";
+    int tables = 0;
+    int scanPercent = 0;
+    int escalation = 0;
+    bool batch = false;
+    int timeoutMs = 0;
+    int claims = 0;
+    bool commit = false;
+    std::string tracePath;
+};
+
+static bool parseStress(int argc, char* argv[], StressOptions& options) {
+    for (int i = 2; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << flag << "\n";
+            return false;
+        }
+        std::string value = argv[++i];
+        if (flag == "--threads") {
+            options.threads = std::atoi(value.c_str());
+        } else if (flag == "--items") {
+            options.items = std::atoi(value.c_str());
+        } else if (flag == "--ops") {
+            options.ops = std::atol(value.c_str());
+        } else if (flag == "--shared") {
+            options.sharedPercent = std::atoi(value.c_str());
+        } else if (flag == "--interval") {
+            options.intervalMs = std::atoi(value.c_str());
+        } else if (flag == "--seed") {
+            options.seed = static_cast<unsigned>(std::atol(value.c_str()));
+        } else if (flag == "--detector" && (value == "off" || value == "fixed" || value == "adaptive")) {
+            options.detector = value;
+        } else if (flag == "--shards") {
+            options.shards = std::atoi(value.c_str());
+        } else if (flag == "--transport" && (value == "inproc" || value == "loopback")) {
+            options.transport = value;
+        } else if (flag == "--tables") {
+            options.tables = std::atoi(value.c_str());
+        } else if (flag == "--scan") {
+            options.scanPercent = std::atoi(value.c_str());
+        } else if (flag == "--escalate") {
+            options.escalation = std::atoi(value.c_str());
+        } else if (flag == "--batch" && (value == "on" || value == "off")) {
+            options.batch = value == "on";
+        } else if (flag == "--commit" && (value == "on" || value == "off")) {
+            options.commit = value == "on";
+        } else if (flag == "--claims") {
+            options.claims = std::atoi(value.c_str());
+        } else if (flag == "--timeout") {
+            options.timeoutMs = std::atoi(value.c_str());
+        } else if (flag == "--metrics") {
+            options.metricsPath = value;
+        } else if (flag == "--trace") {
+            options.tracePath = value;
+        } else if (flag == "--events") {
+            int level = 0;
+            while (level <= static_cast<int>(EventLevel::Off) &&
+                   value != eventLevelName(static_cast<EventLevel>(level))) {
+                ++level;
+            }
+            if (level > static_cast<int>(EventLevel::Off)) {
+                std::cerr << "unknown event level " << value << "\n";
+                return false;
+            }
+            options.events = static_cast<EventLevel>(level);
+        } else if (flag == "--prevention") {
+            if (value == "none") options.prevention = PreventionMode::None;
+            else if (value == "ordering") options.prevention = PreventionMode::LockOrdering;
+            else if (value == "wait-die") options.prevention = PreventionMode::WaitDie;
+            else if (value == "wound-wait") options.prevention = PreventionMode::WoundWait;
+            else if (value == "avoidance") options.prevention = PreventionMode::Avoidance;
+            else {
+                std::cerr << "unknown prevention mode " << value << "\n";
+                return false;
+            }
+        } else {
+            std::cerr << "unknown option " << flag << " " << value << "\n";
+            return false;
+        }
+    }
+    if (options.threads < 1 || options.items < 2 || options.ops < 1 || options.shards < 1) {
+        std::cerr << "need at least 1 thread, 2 items, 1 op and 1 shard\n";
+        return false;
+    }
+    if (options.tables < 0 || options.tables > options.items || (options.scanPercent > 0 && options.tables == 0)) {
+        std::cerr << "--tables must be between 0 and --items, and --scan needs tables\n";
+        return false;
+    }
+    if (options.claims < 0 || options.claims == 1 || options.claims > options.items ||
+        (options.claims > 0 && options.scanPercent > 0)) {
+        std::cerr << "--claims must be 0 or between 2 and --items, and cannot be combined with --scan\n";
+        return false;
+    }
+    if (options.timeoutMs < 0 || (options.timeoutMs > 0 && options.batch)) {
+        std::cerr << "--timeout must not be negative and cannot be combined with --batch\n";
+        return false;
+    }
+    if (!options.tracePath.empty() && !options.commit) {
+        std::cerr << "--trace needs --commit on\n";
+        return false;
+    }
+    return true;
+}
+
+// The items transaction `t` declares and picks its pairs from, as offsets
+// from the first item; every item without --claims.
+static std::vector<int> claimSet(const StressOptions& options, int t, int items) {
+    std::vector<int> set(items);
+    for (int i = 0; i < items; ++i) set[i] = i;
+    if (options.claims == 0) return set;
+    std::mt19937 rng(options.seed * 104729u + t);
+    std::shuffle(set.begin(), set.end(), rng);
+    set.resize(options.claims);
+    std::sort(set.begin(), set.end());
+    return set;
+}
+
+// Takes both items in one all-or-nothing call; only a LockManager has one.
+static bool lockBoth(LockManager& manager, int tid, int first, int second, LockMode mode) {
+    return manager.requestLocks(tid, {first, second}, mode);
+}
+
+static bool lockBoth(LockCluster&, int, int, int, LockMode) {
+    return false;
+}
+
+// Waits on the future the way an event loop would await it; only a
+// LockManager has an asynchronous request.
+static bool lockWithin(LockManager& manager, int tid, int did, LockMode mode, int timeoutMs) {
+    auto outcome = manager.requestLockAsync(tid, did, mode, std::chrono::milliseconds(timeoutMs));
+    return outcome.get() == LockOutcome::Granted;
+}
+
+static bool lockWithin(LockCluster&, int, int, LockMode, int) {
+    return false;
+}
+
+static int beginTransaction(LockManager& manager, const std::vector<int>& claims) {
+    return manager.addTransaction(claims);
+}
+
+static int beginTransaction(LockCluster& cluster, const std::vector<int>&) {
+    return cluster.addTransaction();
+}
+
+// Each thread drives its own transaction: lock two distinct random items,
+// release both, and restart the transaction whenever it was aborted. With
+// --commit each operation instead begins a transaction and commits it, or
+// aborts it if it was terminated, which releases everything at once. Works
+// on a LockManager or a LockCluster; prints the totals and returns seconds.
+// With tables, items start at DID `base` and table k is DID k + 1; a scan
+// locks the items of one table in order and releases them with the table.
+// Given a recorder, every committed transaction's requests go into it.
+template <typename Locker>
+static double runWorkers(Locker& locker, const StressOptions& options, int items, int base = 0,
+                         TraceRecorder* recorder = nullptr) {
+    std::atomic<long> completed(0), refused(0), restarts(0), scans(0);
+    int perTable = options.tables > 0 ? (items + options.tables - 1) / options.tables : 0;
+    std::vector<std::thread> workers;
+    auto began = std::chrono::steady_clock::now();
+    for (int t = 0; t < options.threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::mt19937 rng(options.seed * 7919u + t);
+            std::vector<int> claimed = claimSet(options, t, items);
+            std::vector<int> declared;
+            if (options.claims > 0 || options.prevention == PreventionMode::Avoidance) {
+                for (int item : claimed) declared.push_back(base + item);
+            }
+            int tid = t; // added up front, in thread order
+            // The running transaction's requests so far, for the recorder
+            SimTransaction recorded;
+            auto lastReturned = std::chrono::steady_clock::now();
+            auto note = [&](int did, LockMode mode) {
+                if (!recorder) return;
+                auto thought = std::chrono::steady_clock::now() - lastReturned;
+                SimOp op;
+                op.item = did;
+                op.mode = mode;
+                op.thinkUs = static_cast<int>(std::chrono::duration_cast<std::chrono::microseconds>(thought).count());
+                recorded.ops.push_back(op);
+            };
+            auto lock = [&](int did, LockMode mode) {
+                note(did, mode);
+                bool granted = options.timeoutMs > 0 ? lockWithin(locker, tid, did, mode, options.timeoutMs)
+                                                     : locker.requestLock(tid, did, mode);
+                lastReturned = std::chrono::steady_clock::now();
+                return granted;
+            };
+            auto release = [&](int did) {
+                if (!options.commit) locker.releaseLock(tid, did);
+            };
+            auto finish = [&](bool more) {
+                if (!options.commit) {
+                    if (locker.restartTransaction(tid)) ++restarts;
+                    return;
+                }
+                if (locker.commitTransaction(tid)) {
+                    if (recorder) recorder->add(tid, std::move(recorded));
+                } else {
+                    locker.abortTransaction(tid);
+                    ++restarts;
+                }
+                recorded.ops.clear();
+                if (more) tid = beginTransaction(locker, declared);
+                lastReturned = std::chrono::steady_clock::now();
+            };
+            for (long i = 0; i < options.ops; ++i) {
+                if (static_cast<int>(rng() % 100) < options.scanPercent) {
+                    int table = static_cast<int>(rng() % options.tables);
+                    LockMode mode = static_cast<int>(rng() % 100) < options.sharedPercent ? LockMode::Shared
+                                                                                          : LockMode::Exclusive;
+                    int end = std::min(items, (table + 1) * perTable), item = table * perTable;
+                    while (item < end && lock(base + item, mode)) ++item;
+                    ++(item == end ? scans : refused);
+                    release(table + 1);
+                    finish(i + 1 < options.ops);
+                    continue;
+                }
+                int size = static_cast<int>(claimed.size());
+                int first = static_cast<int>(rng() % size);
+                int second = static_cast<int>(rng() % (size - 1));
+                if (second >= first) ++second;
+                first = claimed[first];
+                second = claimed[second];
+                if (options.prevention == PreventionMode::LockOrdering && first > second) std::swap(first, second);
+                LockMode mode = static_cast<int>(rng() % 100) < options.sharedPercent ? LockMode::Shared
+                                                                                      : LockMode::Exclusive;
+                if (options.batch) {
+                    note(base + first, mode);
+                    note(base + second, mode);
+                    bool granted = lockBoth(locker, tid, base + first, base + second, mode);
+                    lastReturned = std::chrono::steady_clock::now();
+                    if (granted) {
+                        ++completed;
+                        release(base + second);
+                        release(base + first);
+                    } else {
+                        ++refused;
+                    }
+                } else if (lock(base + first, mode)) {
+                    if (lock(base + second, LockMode::Exclusive)) {
+                        ++completed;
+                        release(base + second);
+                    } else {
+                        ++refused;
+                    }
+                    release(base + first);
+                } else {
+                    ++refused;
+                }
+                finish(i + 1 < options.ops);
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+
+    long attempts = options.ops * options.threads;
+    std::cout << "threads " << options.threads << ", items " << items << ", attempts " << attempts << "\n"
+              << "completed " << completed << ", refused " << refused << (options.commit ? ", aborted " : ", restarts ")
+              << restarts << "\n";
+    if (options.scanPercent > 0) std::cout << "table scans " << scans << "\n";
+    std::cout
+              << "elapsed " << seconds << " s, " << static_cast<long>(attempts / seconds) << " attempts/s\n";
+    return seconds;
+}
+
+static int runStress(const StressOptions& options) {
+    LockManager manager;
+    manager.setBlocking(true);
+    manager.setPreventionMode(options.prevention);
+    EventLevel level = options.events;
+    manager.events().setLevel(level);
+    manager.setEscalationThreshold(options.escalation);
+    int base = 0;
+    if (options.tables > 0) {
+        int database = manager.addDataItem();
+        for (int k = 0; k < options.tables; ++k) manager.addDataItem(database);
+        base = options.tables + 1;
+    }
+    int perTable = options.tables > 0 ? (options.items + options.tables - 1) / options.tables : 0;
+    for (int i = 0; i < options.items; ++i) manager.addDataItem(perTable ? 1 + i / perTable : -1);
+    for (int t = 0; t < options.threads; ++t) {
+        std::vector<int> claims;
+        if (options.claims > 0 || options.prevention == PreventionMode::Avoidance) {
+            for (int item : claimSet(options, t, options.items)) claims.push_back(base + item);
+        }
+        manager.addTransaction(claims);
+    }
+
+    DeadlockDetector detector(manager);
+    if (options.timeoutMs > 0) manager.setOnlineResolution(false);
+    if (options.detector != "off") {
+        manager.setOnlineResolution(false);
+        if (options.detector == "adaptive") {
+            detector.setAdaptive(std::chrono::milliseconds(1), std::chrono::milliseconds(options.intervalMs));
+        } else {
+            detector.setFixedInterval(std::chrono::milliseconds(options.intervalMs));
+        }
+        detector.start();
+    }
+
+    TraceRecorder recorder;
+    // Drains the event ring the way a log viewer would, formatting in batches
+    std::atomic<bool> done(false);
+    long eventCount = 0;
+    std::thread collector([&] {
+        std::vector<Event> batch;
+        for (bool last = false; !last;) {
+            last = done;
+            batch.clear();
+            while (manager.events().drain(batch, 4096) > 0) {
+                eventCount += static_cast<long>(batch.size());
+                formatEvents(batch);
+                batch.clear();
+            }
+            if (!last) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    double seconds = runWorkers(manager, options, options.items, base, options.tracePath.empty() ? nullptr : &recorder);
+    detector.stop();
+    done = true;
+    collector.join();
+    if (options.detector != "off") {
+        DetectorStats stats = detector.stats();
+        std::cout << "detector passes " << stats.passes << ", deadlocks " << stats.deadlocksResolved << ", victims "
+                  << stats.victims << ", detection time " << stats.detectionMs << " ms (cpu "
+                  << stats.detectionCpuMs << " ms)\n"
+                  << "detection latency mean " << stats.meanLatencyMs << " ms, max " << stats.maxLatencyMs
+                  << " ms\n";
+    }
+    MetricsSnapshot metrics;
+    manager.snapshotMetrics(metrics, 5);
+    std::cout << "waited " << metrics[Counter::Waited] << ", lock wait p50 " << metrics.waitNs.percentile(0.5) / 1e3
+              << " us, p99 " << metrics.waitNs.percentile(0.99) / 1e3 << " us, max " << metrics.waitNs.max / 1e3
+              << " us\nhottest items";
+    for (const auto& item : metrics.hotItems) std::cout << " D" << item.first << " (" << item.second << ")";
+    std::cout << "\n";
+    if (options.escalation > 0) std::cout << "escalations " << metrics[Counter::Escalations] << "\n";
+    if (options.timeoutMs > 0) std::cout << "timeouts " << metrics[Counter::Timeouts] << "\n";
+    if (options.commit) {
+        std::cout << "commits " << metrics[Counter::Commits] << ", aborts " << metrics[Counter::Aborts]
+                  << ", transaction slots " << manager.transactionCount() << "\n";
+    }
+    if (options.prevention == PreventionMode::Avoidance) {
+        std::cout << "unsafe deferrals " << metrics[Counter::UnsafeDeferrals] << ", deadlocks formed "
+                  << metrics[Counter::DeadlocksFormed] << "\n";
+    }
+    if (!options.metricsPath.empty()) {
+        std::string log;
+        bool written = writeMetrics(metrics, options.metricsPath, log);
+        (written ? std::cout : std::cerr) << log << "\n";
+        if (!written) return 1;
+    }
+    if (level != EventLevel::Off) {
+        std::cout << "events " << eventCount << " (" << static_cast<long>(eventCount / seconds) << "/s), dropped "
+                  << manager.events().dropped() << "\n";
+    }
+    if (!options.tracePath.empty()) {
+        std::string log;
+        bool written = recorder.save(options.tracePath, log);
+        (written ? std::cout : std::cerr) << log << "\n";
+        if (!written) return 1;
+    }
+    // Every lock was released, so nothing may be left held, queued or in the graph
+    int holding = 0;
+    for (int slot = 0; slot < manager.transactionCount(); ++slot) {
+        int tid = manager.transactionAt(slot);
+        if (tid != -1) holding += !manager.heldLocks(tid).empty();
+    }
+    if (manager.blockedRequestCount() != 0 || manager.getWaitForGraph().size() != 0 || holding != 0) {
+        std::cerr << "inconsistent state: " << manager.blockedRequestCount() << " queued requests, "
+                  << manager.getWaitForGraph().size() << " wait-for edges, " << holding
+                  << " transactions holding locks\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Same workload over shards. Waits that cross shards are invisible to each
+// shard's online check and are left to the global detector.
+static int runCluster(const StressOptions& options) {
+    if (options.tables > 0 || options.batch || options.timeoutMs > 0 || options.claims > 0 ||
+        options.prevention == PreventionMode::Avoidance || !options.tracePath.empty()) {
+        std::cerr << "cluster does not support --tables, --batch, --timeout, --claims, --trace or avoidance\n";
+        return 2;
+    }
+    int perShard = std::max(1, options.items / options.shards);
+    LockCluster cluster(options.shards, perShard);
+    for (int i = 0; i < cluster.shardCount(); ++i) cluster.shard(i).setBlocking(true);
+    for (int i = 0; i < options.threads; ++i) cluster.addTransaction();
+
+    std::unique_ptr<Transport> transport;
+    if (options.transport == "loopback") {
+        LoopbackTransport* loopback = new LoopbackTransport(cluster.handlers());
+        transport.reset(loopback);
+        std::string log;
+        if (!loopback->ready(log)) {
+            std::cerr << log << "\n";
+            return 1;
+        }
+    } else {
+        transport.reset(new InProcessTransport(cluster.handlers()));
+    }
+    ClusterDetector detector(*transport);
+    detector.setInterval(std::chrono::milliseconds(options.intervalMs));
+    detector.start();
+    runWorkers(cluster, options, cluster.dataItemCount());
+    detector.stop();
+
+    ClusterDetectorStats stats = detector.stats();
+    std::cout << "shards " << cluster.shardCount() << " over " << options.transport << ", global passes "
+              << stats.passes << ", deadlocks " << stats.deadlocksResolved << ", phantoms " << stats.phantoms
+              << ", victims " << stats.victims << "\n"
+              << "messages " << stats.messages << ", failed " << stats.failedCalls << ", detection time "
+              << stats.detectionMs << " ms\n";
+    for (int i = 0; i < cluster.shardCount(); ++i) {
+        LockManager& shard = cluster.shard(i);
+        if (shard.blockedRequestCount() != 0 || shard.getWaitForGraph().size() != 0) {
+            std::cerr << "inconsistent state on shard " << i << ": " << shard.blockedRequestCount()
+                      << " queued requests, " << shard.getWaitForGraph().size() << " wait-for edges\n";
+            return 1;
+        }
+    }
+    return stats.failedCalls == 0 ? 0 : 1;
+}
+
+static int runClassify(int argc, char* argv[]) {
+    std::vector<std::string> files;
+    int threads = 0;
+    WaitForGraph::Engine engine = WaitForGraph::Engine::Auto;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threads = std::atoi(argv[++i]);
+        } else if (arg == "--engine" && i + 1 < argc) {
+            std::string value = argv[++i];
+            if (value == "auto") engine = WaitForGraph::Engine::Auto;
+            else if (value == "lists") engine = WaitForGraph::Engine::Lists;
+            else if (value == "matrix") engine = WaitForGraph::Engine::Matrix;
+            else {
+                std::cerr << "unknown engine " << value << "\n";
+                return 2;
+            }
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty()) {
+        usage();
+        return 2;
+    }
+    BatchClassifier classifier(threads);
+    classifier.setEngine(engine);
+    bool allCorrect = true;
+    for (const auto& file : files) {
+        BatchReport report;
+        std::string log;
+        if (!classifier.classifyFile(file, report, log)) {
+            std::cerr << log << "\n";
+            return 1;
+        }
+        std::cout << file << ": " << log << "\n"
+                  << std::fixed << std::setprecision(2)
+                  << "  accuracy " << 100 * report.accuracy() << "% (" << report.truePositive + report.trueNegative
+                  << "/" << report.labeled() << "), tp " << report.truePositive << ", fp " << report.falsePositive
+                  << ", tn " << report.trueNegative << ", fn " << report.falseNegative;
+        if (report.unlabeled) std::cout << ", unlabeled " << report.unlabeled;
+        std::cout << "\n  " << static_cast<long>(report.graphsPerSecond()) << " graphs/s, latency us p50 "
+                  << report.p50Us << ", p90 " << report.p90Us << ", p99 " << report.p99Us << ", max " << report.maxUs
+                  << "\n";
+        std::cout.unsetf(std::ios::floatfield);
+        if (report.falsePositive || report.falseNegative) allCorrect = false;
+    }
+    return allCorrect ? 0 : 1;
+}
+
+// Prints CSV on stdout and everything else on stderr, so the output can be
+// redirected straight into a spreadsheet or a plotting script.
+static int runSimulate(int argc, char* argv[]) {
+    WorkloadOptions workload;
+    std::vector<SimPolicy> policies;
+    std::string tracePath, recordPath;
+    int threads = 8, retries = 1000;
+    for (int i = 2; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << flag << "\n";
+            usage();
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (flag == "--threads") {
+            threads = std::atoi(value.c_str());
+        } else if (flag == "--transactions") {
+            workload.transactions = std::atoi(value.c_str());
+        } else if (flag == "--items") {
+            workload.items = std::atoi(value.c_str());
+        } else if (flag == "--locks") {
+            size_t dash = value.find('-');
+            workload.minLocks = std::atoi(value.substr(0, dash).c_str());
+            workload.maxLocks = dash == std::string::npos ? workload.minLocks : std::atoi(value.c_str() + dash + 1);
+        } else if (flag == "--skew") {
+            workload.skew = std::atof(value.c_str());
+        } else if (flag == "--writes") {
+            workload.writePercent = std::atoi(value.c_str());
+        } else if (flag == "--think") {
+            workload.thinkUs = std::atoi(value.c_str());
+        } else if (flag == "--seed") {
+            workload.seed = static_cast<unsigned>(std::atol(value.c_str()));
+        } else if (flag == "--trace") {
+            tracePath = value;
+        } else if (flag == "--record") {
+            recordPath = value;
+        } else if (flag == "--retries") {
+            retries = std::atoi(value.c_str());
+        } else if (flag == "--policy") {
+            SimPolicy policy;
+            std::string log;
+            if (!WorkloadSimulator::parsePolicy(value, policy, log)) {
+                std::cerr << log << "\n";
+                return 2;
+            }
+            policies.push_back(policy);
+        } else {
+            std::cerr << "unknown option " << flag << " " << value << "\n";
+            usage();
+            return 2;
+        }
+    }
+    if (threads < 1 || workload.transactions < 1 || workload.items < 1 || workload.minLocks < 1 ||
+        workload.maxLocks < workload.minLocks || workload.maxLocks > workload.items || workload.skew < 0 ||
+        workload.thinkUs < 0 || retries < 0) {
+        std::cerr << "need at least 1 thread, 1 transaction and 1 item, 1 <= MIN <= MAX <= --items locks,\n"
+                     "and no negative skew, think time or retries\n";
+        return 2;
+    }
+    if (policies.empty()) policies = WorkloadSimulator::defaultPolicies();
+
+    WorkloadSimulator simulator(threads, retries);
+    std::string log;
+    if (!tracePath.empty()) {
+        if (!simulator.loadTrace(tracePath, log)) {
+            std::cerr << log << "\n";
+            return 1;
+        }
+        std::cerr << log << "\n";
+    } else {
+        simulator.generate(workload);
+    }
+    if (!recordPath.empty()) {
+        bool written = simulator.saveTrace(recordPath, log);
+        std::cerr << log << "\n";
+        if (!written) return 1;
+    }
+    std::cout << WorkloadSimulator::csvHeader() << "\n";
+    bool complete = true;
+    for (const SimPolicy& policy : policies) {
+        SimResult result = simulator.run(policy);
+        std::cout << WorkloadSimulator::csvRow(result) << std::endl;
+        if (result.committed + result.gaveUp != result.transactions) complete = false;
+    }
+    return complete ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        usage();
+        return 2;
+    }
+    std::string command = argv[1];
+    if (command == "demo") return runDemo();
+    if (command == "classify") return runClassify(argc, argv);
+    if (command == "simulate") return runSimulate(argc, argv);
+    if (command == "stress" || command == "cluster") {
+        StressOptions options;
+        if (!parseStress(argc, argv, options)) {
+            usage();
+            return 2;
+        }
+        return command == "stress" ? runStress(options) : runCluster(options);
+    }
+    usage();
+    return 2;
+}
@@ -0,0 +1,239 @@
+#include "Cluster.h"
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+
+std::string ShardNode::handle(const std::string& request) {
+    std::istringstream in(request);
+    std::string command;
+    in >> command;
+    if (command == "EDGES") {
+        std::vector<std::pair<int, int>> edges;
+        manager.waitForEdges(edges);
+        std::ostringstream out;
+        out << "EDGES " << edges.size();
+        for (const auto& e : edges) out << " " << e.first << " " << e.second;
+        return out.str();
+    }
+    int tid;
+    if (command == "ABORT" && in >> tid) {
+        bool terminated = manager.terminateVictim(tid);
+        return "ABORTED " + std::to_string(tid) + (terminated ? " 1" : " 0");
+    }
+    return "ERROR unknown request " + request;
+}
+
+LockCluster::LockCluster(int shardCount, int itemsPerShard) : itemsPerShard(itemsPerShard) {
+    for (int i = 0; i < shardCount; ++i) {
+        shards.emplace_back(new LockManager);
+        nodes.emplace_back(new ShardNode(*shards.back()));
+        for (int did = 0; did < itemsPerShard; ++did) shards.back()->addDataItem();
+    }
+}
+
+std::vector<Transport::Handler> LockCluster::handlers() {
+    std::vector<Transport::Handler> result;
+    for (auto& node : nodes) {
+        ShardNode* n = node.get();
+        result.push_back([n](const std::string& request) { return n->handle(request); });
+    }
+    return result;
+}
+
+int LockCluster::addTransaction() {
+    std::lock_guard<std::mutex> lock(addMutex);
+    int tid = -1;
+    for (auto& shard : shards) tid = shard->addTransaction();
+    return tid;
+}
+
+bool LockCluster::requestLock(int tid, int did, LockMode mode) {
+    if (did < 0 || did >= dataItemCount()) return false;
+    return shards[shardOf(did)]->requestLock(tid, did % itemsPerShard, mode);
+}
+
+void LockCluster::releaseLock(int tid, int did) {
+    if (did < 0 || did >= dataItemCount()) return;
+    shards[shardOf(did)]->releaseLock(tid, did % itemsPerShard);
+}
+
+bool LockCluster::restartTransaction(int tid) {
+    bool restarted = false;
+    for (auto& shard : shards) restarted = shard->restartTransaction(tid) || restarted;
+    return restarted;
+}
+
+bool LockCluster::commitTransaction(int tid) {
+    std::lock_guard<std::mutex> lock(addMutex);
+    bool committed = true;
+    for (auto& shard : shards) committed = shard->commitTransaction(tid) && committed;
+    if (!committed) {
+        for (auto& shard : shards) shard->abortTransaction(tid);
+    }
+    return committed;
+}
+
+bool LockCluster::abortTransaction(int tid) {
+    std::lock_guard<std::mutex> lock(addMutex);
+    bool aborted = false;
+    for (auto& shard : shards) aborted = shard->abortTransaction(tid) || aborted;
+    return aborted;
+}
+
+ClusterDetector::ClusterDetector(Transport& transport)
+    : transport(transport), interval(100), stopping(false) {}
+
+ClusterDetector::~ClusterDetector() {
+    stop();
+}
+
+void ClusterDetector::setInterval(std::chrono::milliseconds period) {
+    std::lock_guard<std::mutex> lock(mutex);
+    interval = std::max(period, std::chrono::milliseconds(1));
+    wake.notify_all();
+}
+
+void ClusterDetector::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (worker.joinable()) return;
+    stopping = false;
+    worker = std::thread(&ClusterDetector::run, this);
+}
+
+void ClusterDetector::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!worker.joinable()) return;
+        stopping = true;
+        wake.notify_all();
+    }
+    worker.join();
+    std::lock_guard<std::mutex> lock(mutex);
+    worker = std::thread();
+}
+
+void ClusterDetector::run() {
+    std::string log;
+    for (;;) {
+        runOnce(log);
+        std::unique_lock<std::mutex> lock(mutex);
+        auto deadline = std::chrono::steady_clock::now() + interval;
+        std::chrono::milliseconds planned = interval;
+        wake.wait_until(lock, deadline, [&] { return stopping || interval != planned; });
+        if (stopping) return;
+    }
+}
+
+bool ClusterDetector::collect(std::vector<std::pair<int, int>>& edges, std::string& log) {
+    edges.clear();
+    for (int node = 0; node < transport.nodeCount(); ++node) {
+        std::string reply;
+        bool delivered = transport.call(node, "EDGES", reply, log);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++totals.messages;
+            if (!delivered) ++totals.failedCalls;
+        }
+        std::istringstream in(reply);
+        std::string tag;
+        size_t count = 0;
+        if (!delivered || !(in >> tag >> count) || tag != "EDGES") {
+            if (delivered) log = "Bad reply from node " + std::to_string(node) + ": " + reply;
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            int from, to;
+            if (!(in >> from >> to)) {
+                log = "Truncated reply from node " + std::to_string(node);
+                return false;
+            }
+            edges.push_back({from, to});
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    return true;
+}
+
+static std::string formatGroups(const std::vector<std::vector<int>>& groups) {
+    std::string text;
+    for (const auto& group : groups) {
+        text += " {";
+        for (size_t i = 0; i < group.size(); ++i) text += (i ? " T" : "T") + std::to_string(group[i]);
+        text += "}";
+    }
+    return text;
+}
+
+int ClusterDetector::runOnce(std::string& log) {
+    log.clear();
+    auto began = std::chrono::steady_clock::now();
+    std::vector<std::pair<int, int>> first, second, stable;
+    std::vector<std::vector<int>> seen, confirmed;
+    std::vector<int> victims;
+    WaitForGraph graph;
+    // TIDs of reused slots are sparse, so graph nodes are their ranks
+    std::vector<int> tids;
+    auto node = [&](int tid) { return static_cast<int>(std::lower_bound(tids.begin(), tids.end(), tid) - tids.begin()); };
+    if (collect(first, log)) {
+        for (const auto& e : first) {
+            tids.push_back(e.first);
+            tids.push_back(e.second);
+        }
+        std::sort(tids.begin(), tids.end());
+        tids.erase(std::unique(tids.begin(), tids.end()), tids.end());
+        for (const auto& e : first) graph.addEdge(node(e.first), node(e.second));
+        seen = graph.deadlockedComponents();
+    }
+    if (!seen.empty() && collect(second, log)) {
+        // A real deadlock cannot go away by itself, so its edges are in both rounds
+        std::set_intersection(first.begin(), first.end(), second.begin(), second.end(), std::back_inserter(stable));
+        graph.clear();
+        for (const auto& e : stable) graph.addEdge(node(e.first), node(e.second));
+        confirmed = graph.deadlockedComponents();
+        victims = graph.breakingSet(confirmed, [](int) { return 0.0; }, [&](int n) { return static_cast<long>(tids[n]); });
+        for (auto& group : confirmed) {
+            for (int& member : group) member = tids[member];
+        }
+        for (int& victim : victims) victim = tids[victim];
+    }
+    long messages = 0, failed = 0;
+    int aborted = 0;
+    for (int tid : victims) {
+        bool any = false;
+        for (int node = 0; node < transport.nodeCount(); ++node) {
+            std::string reply, error;
+            ++messages;
+            if (!transport.call(node, "ABORT " + std::to_string(tid), reply, error)) {
+                ++failed;
+                log += (log.empty() ? "" : "; ") + error;
+                continue;
+            }
+            any = any || reply == "ABORTED " + std::to_string(tid) + " 1";
+        }
+        if (any) ++aborted;
+    }
+    if (!confirmed.empty()) {
+        std::string text = std::to_string(confirmed.size()) + " global deadlocked group(s):" + formatGroups(confirmed) +
+                           "; terminated";
+        for (int tid : victims) text += " T" + std::to_string(tid);
+        text += " on " + std::to_string(transport.nodeCount()) + " shard(s)";
+        log = log.empty() ? text : text + "; " + log;
+    }
+    auto finished = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ++totals.passes;
+    totals.detectionMs += std::chrono::duration<double, std::milli>(finished - began).count();
+    totals.deadlocksResolved += static_cast<long>(confirmed.size());
+    totals.phantoms += static_cast<long>(seen.size() > confirmed.size() ? seen.size() - confirmed.size() : 0);
+    totals.victims += aborted;
+    totals.messages += messages;
+    totals.failedCalls += failed;
+    return aborted;
+}
+
+ClusterDetectorStats ClusterDetector::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return totals;
+}
@@ -0,0 +1,163 @@
+#include "DeadlockDetector.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// CPU time used so far by the calling thread, in milliseconds.
+static double threadCpuMs() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user)) return 0;
+    auto ticks = [](const FILETIME& t) {
+        return (static_cast<unsigned long long>(t.dwHighDateTime) << 32) | t.dwLowDateTime;
+    };
+    return (ticks(kernel) + ticks(user)) / 1e4; // 100 ns units
+#else
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) return 0;
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+#endif
+}
+
+DeadlockDetector::DeadlockDetector(LockManager& manager)
+    : manager(manager), minInterval(100), maxInterval(100), interval(100), adaptive(false), lastBlocked(0),
+      stopping(false) {}
+
+DeadlockDetector::~DeadlockDetector() {
+    stop();
+}
+
+void DeadlockDetector::setFixedInterval(std::chrono::milliseconds period) {
+    std::lock_guard<std::mutex> lock(mutex);
+    adaptive = false;
+    minInterval = maxInterval = interval = std::max(period, std::chrono::milliseconds(1));
+    wake.notify_all();
+}
+
+void DeadlockDetector::setAdaptive(std::chrono::milliseconds minPeriod, std::chrono::milliseconds maxPeriod) {
+    std::lock_guard<std::mutex> lock(mutex);
+    adaptive = true;
+    minInterval = std::max(minPeriod, std::chrono::milliseconds(1));
+    maxInterval = std::max(maxPeriod, minInterval);
+    interval = std::min(std::max(interval, minInterval), maxInterval);
+    wake.notify_all();
+}
+
+void DeadlockDetector::setReporter(std::function<void(const std::string&)> report) {
+    std::lock_guard<std::mutex> lock(mutex);
+    reporter = std::move(report);
+}
+
+void DeadlockDetector::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (worker.joinable()) return;
+    stopping = false;
+    worker = std::thread(&DeadlockDetector::run, this);
+}
+
+void DeadlockDetector::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!worker.joinable()) return;
+        stopping = true;
+        wake.notify_all();
+    }
+    worker.join();
+    std::lock_guard<std::mutex> lock(mutex);
+    worker = std::thread();
+}
+
+bool DeadlockDetector::isRunning() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return worker.joinable() && !stopping;
+}
+
+void DeadlockDetector::run() {
+    std::string log;
+    for (;;) {
+        std::function<void(const std::string&)> report;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            report = reporter;
+        }
+        // Nobody reads the log without a reporter, so skip building it
+        std::chrono::milliseconds delay = report ? runOnce(log) : runOnce();
+        if (!log.empty() && report) report(log);
+        std::unique_lock<std::mutex> lock(mutex);
+        // Re-read the interval after a settings change instead of sleeping out the old one
+        auto deadline = std::chrono::steady_clock::now() + delay;
+        std::chrono::milliseconds planned = interval;
+        wake.wait_until(lock, deadline, [&] { return stopping || interval != planned; });
+        if (stopping) return;
+    }
+}
+
+std::chrono::milliseconds DeadlockDetector::runOnce(std::string& log) {
+    log.clear();
+    return runPass(&log);
+}
+
+std::chrono::milliseconds DeadlockDetector::runOnce() {
+    return runPass(nullptr);
+}
+
+std::chrono::milliseconds DeadlockDetector::runPass(std::string* log) {
+    auto began = std::chrono::steady_clock::now();
+    double cpuBegan = threadCpuMs();
+    std::string detectLog;
+    std::vector<std::vector<int>> components;
+    bool found = log ? manager.detectAllDeadlocks(detectLog, components) : manager.detectAllDeadlocks(components);
+    std::vector<std::chrono::steady_clock::time_point> formed(components.size());
+    std::vector<char> known(components.size(), 0);
+    std::vector<int> victims;
+    if (found) {
+        for (size_t i = 0; i < components.size(); ++i) {
+            known[i] = manager.deadlockFormedAt(components[i], formed[i]);
+        }
+        if (log) {
+            std::string recoverLog;
+            manager.recoverAll(components, recoverLog, victims);
+            *log = detectLog + "\n" + recoverLog;
+        } else {
+            manager.recoverAll(components, victims);
+        }
+    }
+    auto finished = std::chrono::steady_clock::now();
+    double cpu = threadCpuMs() - cpuBegan;
+    long blocked = manager.blockedRequestCount();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ++totals.passes;
+    totals.detectionMs += std::chrono::duration<double, std::milli>(finished - began).count();
+    totals.detectionCpuMs += cpu;
+    totals.deadlocksResolved += static_cast<long>(components.size());
+    totals.victims += static_cast<long>(victims.size());
+    for (size_t i = 0; i < components.size(); ++i) {
+        if (!known[i]) continue;
+        double latency = std::chrono::duration<double, std::milli>(finished - formed[i]).count();
+        ++totals.latencySamples;
+        totals.meanLatencyMs += (latency - totals.meanLatencyMs) / totals.latencySamples;
+        totals.maxLatencyMs = std::max(totals.maxLatencyMs, latency);
+    }
+    if (adaptive) {
+        if (found || blocked > lastBlocked) {
+            interval = std::max(minInterval, interval / 2);
+        } else if (blocked == 0) {
+            interval = std::min(maxInterval, interval * 2);
+        }
+    }
+    lastBlocked = blocked;
+    totals.interval = interval;
+    return interval;
+}
+
+DetectorStats DeadlockDetector::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return totals;
+}
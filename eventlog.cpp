@@ -0,0 +1,282 @@
+#include "EventLog.h"
+#include <sstream>
+
+EventLevel eventLevel(EventType type) {
+    switch (type) {
+    case EventType::Acquired:
+    case EventType::Upgraded:
+    case EventType::AlreadyHolds:
+    case EventType::Covered:
+    case EventType::Released:
+    case EventType::Granted:
+    case EventType::NoDeadlock:
+    case EventType::Committed:
+        return EventLevel::Debug;
+    case EventType::Waiting:
+    case EventType::UnsafeDeferred:
+    case EventType::DeadlockDetected:
+    case EventType::NothingToRecover:
+    case EventType::AlreadyResolved:
+    case EventType::GroupsDetected:
+    case EventType::Group:
+    case EventType::Restarted:
+    case EventType::Escalated:
+    case EventType::Aborted:
+        return EventLevel::Info;
+    case EventType::OrderingDenied:
+    case EventType::BatchUnavailable:
+    case EventType::TimedOut:
+    case EventType::ClaimExceeded:
+    case EventType::AlreadyWaiting:
+    case EventType::WouldCloseDeadlock:
+    case EventType::TerminatedWhileWaiting:
+    case EventType::WaitDieAborted:
+    case EventType::Wounded:
+    case EventType::NotHeld:
+    case EventType::DeadlockFormed:
+    case EventType::VictimTerminated:
+    case EventType::VictimsTerminated:
+        return EventLevel::Warning;
+    case EventType::InvalidTransaction:
+    case EventType::NoSuchItem:
+    case EventType::NotTerminated:
+        return EventLevel::Error;
+    }
+    return EventLevel::Error;
+}
+
+const char* eventLevelName(EventLevel level) {
+    static const char* const kNames[] = {"debug", "info", "warning", "error", "off"};
+    return kNames[static_cast<int>(level)];
+}
+
+// Clauses that extend the previous one instead of starting a new sentence
+static bool continuesLine(EventType type) {
+    return type == EventType::Granted || type == EventType::DeadlockFormed || type == EventType::Group;
+}
+
+static void writeTids(std::ostream& out, const Event& event) {
+    for (int i = 0; i < event.idCount; ++i) out << " T" << event.ids[i];
+    if (event.total > event.idCount) out << " (+" << event.total - event.idCount << " more)";
+}
+
+static void writeCycle(std::ostream& out, const Event& event) {
+    for (int i = 0; i < event.idCount; ++i) out << (i ? " -> T" : "T") << event.ids[i];
+    if (event.total > event.idCount) out << " -> ... (+" << event.total - event.idCount << " more)";
+}
+
+static std::string describeLock(LockMode mode) {
+    if (mode == LockMode::Shared) return "shared lock";
+    if (mode == LockMode::Exclusive) return "lock";
+    return std::string(lockModeName(mode)) + " lock";
+}
+
+std::string formatEvent(const Event& e) {
+    std::ostringstream out;
+    switch (e.type) {
+    case EventType::InvalidTransaction:
+        out << "Invalid or inactive transaction T" << e.tid;
+        break;
+    case EventType::NoSuchItem:
+        out << "Data item D" << e.did << " does not exist";
+        break;
+    case EventType::OrderingDenied:
+        out << "Request denied: T" << e.tid << " cannot request D" << e.did << " (holds D" << e.value << ")";
+        break;
+    case EventType::AlreadyHolds:
+        out << "T" << e.tid << " already holds " << describeLock(e.mode) << " on D" << e.did;
+        break;
+    case EventType::AlreadyWaiting:
+        out << "T" << e.tid << " is already waiting for D" << e.did;
+        break;
+    case EventType::Acquired:
+        out << "T" << e.tid << " acquired " << describeLock(e.mode) << " on D" << e.did;
+        break;
+    case EventType::Upgraded:
+        out << "T" << e.tid << " upgraded lock on D" << e.did << " to ";
+        if (e.mode == LockMode::Exclusive) {
+            out << "exclusive";
+        } else {
+            out << lockModeName(e.mode);
+        }
+        break;
+    case EventType::Waiting:
+        out << "T" << e.tid << " waiting for " << lockModeName(e.mode) << " lock on D" << e.did;
+        if (e.total > 0) {
+            out << " held by";
+            writeTids(out, e);
+        }
+        break;
+    case EventType::WouldCloseDeadlock:
+        out << "Request denied: T" << e.tid << " waiting for D" << e.did << " would close a deadlock";
+        break;
+    case EventType::TerminatedWhileWaiting:
+        out << "T" << e.tid << " was terminated while waiting for D" << e.did;
+        break;
+    case EventType::WaitDieAborted:
+        out << "T" << e.tid << " aborted by wait-die: D" << e.did << " is held or requested by older";
+        writeTids(out, e);
+        break;
+    case EventType::Wounded:
+        out << "T" << e.tid << " wounded";
+        writeTids(out, e);
+        out << " over D" << e.did;
+        break;
+    case EventType::Released:
+        out << "T" << e.tid << " released "
+            << (e.mode == LockMode::Shared || e.mode == LockMode::Exclusive ? "lock" : describeLock(e.mode))
+            << " on D" << e.did;
+        break;
+    case EventType::NotHeld:
+        out << "T" << e.tid << " does not hold D" << e.did;
+        break;
+    case EventType::Granted:
+        out << "; D" << e.did << " granted to";
+        writeTids(out, e);
+        break;
+    case EventType::DeadlockFormed:
+        out << "; deadlock formed: ";
+        writeCycle(out, e);
+        break;
+    case EventType::DeadlockDetected:
+        out << "Deadlock detected: ";
+        writeCycle(out, e);
+        break;
+    case EventType::NoDeadlock:
+        out << "No deadlock detected";
+        break;
+    case EventType::NothingToRecover:
+        out << "No deadlock to recover from";
+        break;
+    case EventType::AlreadyResolved:
+        out << "Deadlock already resolved";
+        break;
+    case EventType::VictimTerminated:
+        out << "Terminated T" << e.tid << " to resolve deadlock";
+        break;
+    case EventType::GroupsDetected:
+        out << e.value << " deadlocked group(s):";
+        break;
+    case EventType::Group: {
+        std::ostringstream members;
+        writeTids(members, e);
+        out << " {" << members.str().substr(1) << "}";
+        break;
+    }
+    case EventType::VictimsTerminated:
+        out << "Terminated";
+        writeTids(out, e);
+        out << " to resolve " << e.value << " deadlocked group(s)";
+        break;
+    case EventType::NotTerminated:
+        out << "T" << e.tid << " is not a terminated transaction";
+        break;
+    case EventType::Restarted:
+        out << "Restarted T" << e.tid << " (aborted " << e.value << " time(s))";
+        break;
+    case EventType::Covered:
+        out << "T" << e.tid << " already holds " << describeLock(e.mode) << " on D" << e.did << " through D" << e.value;
+        break;
+    case EventType::Escalated:
+        out << "T" << e.tid << " escalated " << e.value << " lock(s) under D" << e.did << " to " << describeLock(e.mode);
+        break;
+    case EventType::BatchUnavailable:
+        out << "Request denied: T" << e.tid << " cannot lock all " << e.value << " item(s) at once; D" << e.did
+            << " is held or requested by";
+        writeTids(out, e);
+        break;
+    case EventType::TimedOut:
+        out << "Request timed out: T" << e.tid << " gave up waiting for D" << e.did;
+        break;
+    case EventType::ClaimExceeded:
+        out << "Request denied: " << describeLock(e.mode) << " on D" << e.did << " is outside T" << e.tid
+            << "'s declared claims";
+        break;
+    case EventType::UnsafeDeferred:
+        out << "T" << e.tid << " waiting for " << lockModeName(e.mode) << " lock on D" << e.did
+            << ": granting it now is unsafe, T" << e.value << " may still request it";
+        break;
+    case EventType::Committed:
+        out << "T" << e.tid << " committed, releasing " << e.value << " lock(s)";
+        break;
+    case EventType::Aborted:
+        out << "T" << e.tid << " aborted, releasing " << e.value << " lock(s)";
+        break;
+    }
+    return out.str();
+}
+
+std::string formatEvents(const std::vector<Event>& events) {
+    std::string text;
+    bool lineStart = true;
+    for (size_t i = 0; i < events.size(); ++i) {
+        const Event& e = events[i];
+        if (i > 0 && e.operation != events[i - 1].operation) {
+            text += '\n';
+            lineStart = true;
+        }
+        std::string clause = formatEvent(e);
+        if (continuesLine(e.type)) {
+            // Its opening clause was filtered out or is on another line
+            if (lineStart) clause.erase(0, clause.find_first_not_of("; "));
+        } else if (!lineStart) {
+            text += "; ";
+        }
+        text += clause;
+        lineStart = false;
+    }
+    return text;
+}
+
+EventLog::EventLog(std::size_t capacity) : minLevel(EventLevel::Off), head(0), tail(0), droppedCount(0) {
+    std::size_t size = 2;
+    while (size < capacity) size <<= 1;
+    slots.reset(new Slot[size]);
+    mask = size - 1;
+    for (std::size_t i = 0; i < size; ++i) slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+bool EventLog::push(const Event& event) {
+    std::uint64_t pos = head.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &slots[pos & mask];
+        std::uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+        std::int64_t diff = static_cast<std::int64_t>(seq - pos);
+        if (diff == 0) {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            // The reader has not freed this slot yet: full
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+    slot->event = event;
+    slot->event.sequence = pos;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+std::size_t EventLog::drain(std::vector<Event>& out, std::size_t max) {
+    std::size_t count = 0;
+    std::uint64_t pos = tail.load(std::memory_order_relaxed);
+    while (count < max) {
+        Slot* slot = &slots[pos & mask];
+        std::uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+        std::int64_t diff = static_cast<std::int64_t>(seq - (pos + 1));
+        if (diff == 0) {
+            if (!tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) continue;
+            out.push_back(slot->event);
+            slot->sequence.store(pos + mask + 1, std::memory_order_release);
+            ++count;
+            ++pos;
+        } else if (diff < 0) {
+            break; // empty, or the next writer has not finished
+        } else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+    return count;
+}
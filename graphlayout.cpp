@@ -0,0 +1,155 @@
+#include "GraphLayout.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include "WaitForGraph.h"
+
+static const double kNodeSpacing = 60.0; // distance between neighbours on a cluster ring
+static const double kPi = 3.14159265358979323846; // M_PI is not standard C++
+static const double kClusterMargin = 60.0;
+
+static int findRoot(std::vector<int>& parent, int v) {
+    while (parent[v] != v) {
+        parent[v] = parent[parent[v]];
+        v = parent[v];
+    }
+    return v;
+}
+
+int GraphLayout::find(int tid) const {
+    auto it = std::lower_bound(nodes.begin(), nodes.end(), tid, [](const Node& n, int t) { return n.tid < t; });
+    return it != nodes.end() && it->tid == tid ? static_cast<int>(it - nodes.begin()) : -1;
+}
+
+// Works on dense IDs, which it uses to index arrays.
+static GraphLayout computeDense(const GraphSnapshot& snapshot) {
+    GraphLayout layout;
+    WaitForGraph graph;
+    for (const auto& e : snapshot.edges) graph.addEdge(e.first, e.second);
+    layout.components = graph.deadlockedComponents();
+
+    std::vector<int> tids = snapshot.transactions;
+    std::sort(tids.begin(), tids.end());
+    tids.erase(std::unique(tids.begin(), tids.end()), tids.end());
+    int maxTid = tids.empty() ? -1 : tids.back();
+    for (const auto& e : snapshot.edges) maxTid = std::max(maxTid, std::max(e.first, e.second));
+
+    std::vector<int> componentOf(maxTid + 1, -1);
+    for (size_t c = 0; c < layout.components.size(); ++c) {
+        for (int tid : layout.components[c]) componentOf[tid] = static_cast<int>(c);
+    }
+    std::vector<char> shown(maxTid + 1, 0), linked(maxTid + 1, 0);
+    for (int tid : tids) shown[tid] = 1;
+    for (const auto& e : snapshot.edges) linked[e.first] = linked[e.second] = 1;
+
+    // Level of detail: idle transactions only while there are few of them
+    std::vector<int> idle;
+    for (int tid : tids) {
+        bool keep = snapshot.deadlockedOnly ? componentOf[tid] != -1 : true;
+        if (!keep) {
+            shown[tid] = 0;
+        } else if (!linked[tid]) {
+            idle.push_back(tid);
+        }
+    }
+    if (snapshot.deadlockedOnly || static_cast<int>(idle.size()) > GraphLayout::kMaxIdleShown) {
+        for (int tid : idle) shown[tid] = 0;
+        layout.collapsedIdle = snapshot.deadlockedOnly ? 0 : static_cast<int>(idle.size());
+        idle.clear();
+    }
+    for (const auto& e : snapshot.edges) {
+        if (shown[e.first] && shown[e.second]) layout.edges.push_back(e);
+    }
+
+    // Clusters: each deadlocked component, then weakly connected groups of
+    // the remaining linked nodes, then the idle ones
+    std::vector<int> parent(maxTid + 1);
+    std::iota(parent.begin(), parent.end(), 0);
+    for (const auto& e : layout.edges) {
+        if (componentOf[e.first] != -1 || componentOf[e.second] != -1) continue;
+        parent[findRoot(parent, e.first)] = findRoot(parent, e.second);
+    }
+    std::vector<std::vector<int>> clusters(layout.components.begin(), layout.components.end());
+    std::vector<int> clusterOfRoot(maxTid + 1, -1);
+    for (int tid : tids) {
+        if (!shown[tid] || componentOf[tid] != -1 || !linked[tid]) continue;
+        int root = findRoot(parent, tid);
+        if (clusterOfRoot[root] == -1) {
+            clusterOfRoot[root] = static_cast<int>(clusters.size());
+            clusters.emplace_back();
+        }
+        clusters[clusterOfRoot[root]].push_back(tid);
+    }
+    size_t firstIdleCluster = clusters.size();
+    if (!idle.empty()) clusters.push_back(idle);
+
+    // Shelf packing: rows roughly as wide as the square root of the total area
+    std::vector<double> radius(clusters.size());
+    double area = 0;
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        double k = static_cast<double>(clusters[c].size());
+        radius[c] = k > 1 ? std::max(kNodeSpacing / 2, k * kNodeSpacing / (2 * kPi)) : 0;
+        double side = 2 * radius[c] + kClusterMargin;
+        area += side * side;
+    }
+    double rowWidth = std::max(4 * kNodeSpacing, std::sqrt(area) * 1.5);
+    double x = 0, y = 0, rowHeight = 0;
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        double side = 2 * radius[c] + kClusterMargin;
+        if (c == firstIdleCluster) {
+            // Idle nodes go in a plain grid on their own row
+            x = 0;
+            y += rowHeight;
+            int perRow = std::max(1, static_cast<int>(rowWidth / kNodeSpacing));
+            for (size_t i = 0; i < clusters[c].size(); ++i) {
+                layout.nodes.push_back({clusters[c][i], (i % perRow + 0.5) * kNodeSpacing,
+                                        y + (i / perRow + 0.5) * kNodeSpacing, -1});
+            }
+            rowHeight = ((clusters[c].size() + perRow - 1) / perRow) * kNodeSpacing;
+            continue;
+        }
+        if (x > 0 && x + side > rowWidth) {
+            x = 0;
+            y += rowHeight;
+            rowHeight = 0;
+        }
+        double cx = x + side / 2, cy = y + side / 2;
+        const auto& members = clusters[c];
+        for (size_t i = 0; i < members.size(); ++i) {
+            double angle = 2 * kPi * i / members.size();
+            layout.nodes.push_back({members[i], cx + radius[c] * std::cos(angle), cy + radius[c] * std::sin(angle),
+                                    componentOf[members[i]]});
+        }
+        x += side;
+        rowHeight = std::max(rowHeight, side);
+    }
+    layout.summaryX = 0;
+    layout.summaryY = y + rowHeight;
+    std::sort(layout.nodes.begin(), layout.nodes.end(),
+              [](const GraphLayout::Node& a, const GraphLayout::Node& b) { return a.tid < b.tid; });
+    return layout;
+}
+
+GraphLayout GraphLayout::compute(const GraphSnapshot& snapshot) {
+    // TIDs of reused transaction slots are sparse, so the layout runs on
+    // their ranks, which keep their order, and is mapped back
+    std::vector<int> ids = snapshot.transactions;
+    for (const auto& e : snapshot.edges) {
+        ids.push_back(e.first);
+        ids.push_back(e.second);
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    auto rank = [&](int tid) { return static_cast<int>(std::lower_bound(ids.begin(), ids.end(), tid) - ids.begin()); };
+    GraphSnapshot dense;
+    dense.deadlockedOnly = snapshot.deadlockedOnly;
+    for (int tid : snapshot.transactions) dense.transactions.push_back(rank(tid));
+    for (const auto& e : snapshot.edges) dense.edges.push_back({rank(e.first), rank(e.second)});
+    GraphLayout layout = computeDense(dense);
+    for (auto& node : layout.nodes) node.tid = ids[node.tid];
+    for (auto& e : layout.edges) e = {ids[e.first], ids[e.second]};
+    for (auto& component : layout.components) {
+        for (int& tid : component) tid = ids[tid];
+    }
+    return layout;
+}
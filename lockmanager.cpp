@@ -1,147 +1,1737 @@
 #include "LockManager.h"
 #include <algorithm>
-#include <sstream>
 
-LockManager::LockManager() : preventionEnabled(false), nextTid(0), nextDid(0) {}
+static std::int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// The claim `tid` declared on an item, or null; claims are sorted by TID.
+static const std::pair<int, LockMode>* findClaim(const std::vector<std::pair<int, LockMode>>& claims, int tid) {
+    auto it = std::lower_bound(claims.begin(), claims.end(), tid,
+                               [](const std::pair<int, LockMode>& c, int t) { return c.first < t; });
+    return it != claims.end() && it->first == tid ? &*it : nullptr;
+}
+
+LockManager::LockManager()
+    : deferredItemCount(0), preventionMode(PreventionMode::None), blocking(false), onlineResolution(true), queuedRequests(0), escalationThreshold(0), nextDid(0), clock(0),
+      victimPolicy(VictimPolicy::Youngest), starvationLimit(3), nextOperation(0), asyncStopping(false) {}
+
+LockManager::~LockManager() {
+    {
+        std::lock_guard<std::mutex> lock(asyncMutex);
+        asyncStopping = true;
+        asyncWake.notify_all();
+    }
+    if (asyncThread.joinable()) asyncThread.join();
+}
+
+int LockManager::addTransaction(const std::vector<int>& claims, LockMode mode) {
+    std::unique_lock<std::shared_mutex> registry(registryMutex);
+    for (int did : claims) {
+        if (!validItem(did)) return -1;
+    }
+    int slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.front();
+        freeSlots.pop_front();
+    } else {
+        slot = static_cast<int>(txTid.size());
+        if (slot > kSlotMask) return -1;
+        txTid.push_back(-1);
+        txGeneration.push_back(0);
+        txActive.push_back(0);
+        txHeld.emplace_back();
+        txWaiting.emplace_back();
+        txStart.push_back(0);
+        txWork.push_back(0);
+        txAborts.push_back(0);
+        txDeadlockedSince.emplace_back();
+        txChildLocks.emplace_back();
+        txCovered.emplace_back();
+        txClaimed.emplace_back();
+        txChanged.push_back(0);
+    }
+    int tid = txGeneration[slot] << kSlotBits | slot;
+    // Every claimed item and its ancestors, each in the mode covering all
+    // the claims that reach it
+    std::vector<std::pair<int, LockMode>> claimed;
+    for (int did : claims) {
+        claimed.push_back({did, mode});
+        for (int p = itemParent[did]; p != -1; p = itemParent[p]) claimed.push_back({p, intentionFor(mode)});
+    }
+    std::sort(claimed.begin(), claimed.end(),
+              [](const std::pair<int, LockMode>& a, const std::pair<int, LockMode>& b) { return a.first < b.first; });
+    for (size_t i = 0; i < claimed.size(); ++i) {
+        int did = claimed[i].first;
+        auto& item = itemClaims[did];
+        auto pos = std::lower_bound(item.begin(), item.end(), tid,
+                                    [](const std::pair<int, LockMode>& c, int t) { return c.first < t; });
+        if (pos != item.end() && pos->first == tid) {
+            pos->second = lockModeSupremum(pos->second, claimed[i].second);
+        } else {
+            item.insert(pos, {tid, claimed[i].second});
+            txClaimed[slot].push_back(did);
+        }
+    }
+    for (int did : txClaimed[slot]) {
+        LockMode claim = findClaim(itemClaims[did], tid)->second;
+        size_t k = 0;
+        for (int h : itemHolders[did]) {
+            if (!lockModesCompatible(itemHolderModes[did][k++], claim)) claimGraph.addEdge(slot, slotOf(h));
+        }
+    }
+    txTid[slot] = tid;
+    txActive[slot] = 1;
+    txStart[slot] = clock++;
+    txWork[slot] = 0;
+    txAborts[slot] = 0;
+    markTransaction(tid);
+    return tid;
+}
 
-int LockManager::addTransaction() {
-    transactions.push_back(Transaction(nextTid));
-    return nextTid++;
+bool LockManager::commitTransaction(int tid, std::string& log) {
+    std::vector<Event> events;
+    Trace trace{&events};
+    bool committed = finishTransaction(tid, true, trace);
+    log = formatEvents(events);
+    return committed;
 }
 
-int LockManager::addDataItem() {
-    dataItems.push_back(nextDid);
-    lockTable[nextDid] = -1; // Initially free
+bool LockManager::abortTransaction(int tid, std::string& log) {
+    std::vector<Event> events;
+    Trace trace{&events};
+    bool aborted = finishTransaction(tid, false, trace);
+    log = formatEvents(events);
+    return aborted;
+}
+
+bool LockManager::finishTransaction(int tid, bool commit, Trace& trace) {
+    std::unique_lock<std::shared_mutex> registry(registryMutex);
+    if (commit ? !validTransaction(tid) : !knownTransaction(tid)) {
+        emit(trace, Event(EventType::InvalidTransaction, tid));
+        return false;
+    }
+    int slot = slotOf(tid);
+    // Claims go first, so waiters are not kept from what the transaction
+    // gives back by its own claims
+    for (int did : txClaimed[slot]) {
+        auto& item = itemClaims[did];
+        auto pos = std::lower_bound(item.begin(), item.end(), tid,
+                                    [](const std::pair<int, LockMode>& c, int t) { return c.first < t; });
+        size_t k = 0;
+        for (int h : itemHolders[did]) {
+            if (h != tid && !lockModesCompatible(itemHolderModes[did][k], pos->second)) {
+                claimGraph.removeEdge(slot, slotOf(h));
+            }
+            ++k;
+        }
+        item.erase(pos);
+    }
+    Event finished(commit ? EventType::Committed : EventType::Aborted, tid);
+    finished.value = static_cast<int>(txHeld[slot].size());
+    // Reported ahead of the grants it causes
+    std::vector<Event> grants;
+    trace.held = &grants;
+    releaseAll(tid, commit ? LockOutcome::Refused : LockOutcome::Aborted, trace);
+    trace.held = nullptr;
+    emit(trace, finished);
+    for (const Event& event : grants) emit(trace, event);
+    lockMetrics.add(commit ? Counter::Commits : Counter::Aborts);
+    txClaimed[slot].clear();
+    txActive[slot] = 0;
+    txTid[slot] = -1;
+    // Generations wrap around before reaching the sign bit
+    txGeneration[slot] = (txGeneration[slot] + 1) & (0x7fffffff >> kSlotBits);
+    freeSlots.push_back(slot);
+    markTransaction(tid);
+    return true;
+}
+
+bool LockManager::restartTransaction(int tid, std::string& log) {
+    std::vector<Event> events;
+    Trace trace{&events};
+    bool restarted = restartTransaction(tid, trace);
+    log = formatEvents(events);
+    return restarted;
+}
+
+bool LockManager::restartTransaction(int tid, Trace& trace) {
+    std::unique_lock<std::shared_mutex> registry(registryMutex);
+    if (!knownTransaction(tid) || txActive[slotOf(tid)]) {
+        emit(trace, Event(EventType::NotTerminated, tid));
+        return false;
+    }
+    txActive[slotOf(tid)] = 1;
+    markTransaction(tid);
+    txWork[slotOf(tid)] = 0;
+    Event restarted(EventType::Restarted, tid);
+    restarted.value = txAborts[slotOf(tid)];
+    emit(trace, restarted);
+    return true;
+}
+
+int LockManager::addDataItem(int parent) {
+    std::unique_lock<std::shared_mutex> registry(registryMutex);
+    if (parent != -1 && !validItem(parent)) return -1;
+    itemHolders.emplace_back(); // Initially free
+    itemHolderModes.emplace_back();
+    itemMode.push_back(LockMode::Shared);
+    itemParent.push_back(parent);
+    itemChildCount.push_back(0);
+    if (parent != -1) ++itemChildCount[parent];
+    itemQueue.emplace_back();
+    itemClaims.emplace_back();
+    itemWaits.emplace_back(0);
+    itemChanged.push_back(0);
     return nextDid++;
 }
 
-bool LockManager::requestLock(int tid, int did, std::string& log) {
-    if (tid >= static_cast<int>(transactions.size()) || !transactions[tid].active) {
-        log = "Invalid or inactive transaction T" + std::to_string(tid);
+void LockManager::emit(Trace& trace, Event event) {
+    if (!trace.text && !trace.held && !eventLog.wants(event.type)) return;
+    if (trace.operation == 0) trace.operation = ++nextOperation;
+    event.operation = trace.operation;
+    if (event.time == 0) event.time = nowNs();
+    if (trace.held) {
+        trace.held->push_back(event);
+        return;
+    }
+    if (eventLog.wants(event.type)) eventLog.push(event);
+    if (trace.text) trace.text->push_back(event);
+}
+
+void LockManager::emitGrants(Trace& trace, const std::vector<int>& granted, int did) {
+    if (granted.empty()) return;
+    emit(trace, Event(EventType::Granted, -1, did).withIds(granted));
+}
+
+bool LockManager::requestLock(int tid, int did, LockMode mode, std::string& log) {
+    std::vector<Event> events;
+    Trace trace{&events};
+    bool granted = requestLock(tid, did, mode, trace);
+    log = formatEvents(events);
+    return granted;
+}
+
+bool LockManager::requestLock(int tid, int did, LockMode mode, Trace& trace) {
+    lockMetrics.add(Counter::Requests);
+    std::vector<int> missing;
+    bool nested = false;
+    if (planLock(tid, did, mode, trace, missing, nested)) return true;
+    auto refuse = [&](int item) {
+        // Intention locks taken on the way are only kept for a queued request
+        if (missing.empty()) return false;
+        std::shared_lock<std::shared_mutex> registry(registryMutex);
+        if (validTransaction(tid)) releaseUnneeded(tid, item, trace);
         return false;
+    };
+    for (int p : missing) {
+        if (!lockItem(tid, p, intentionFor(mode), trace)) return refuse(p);
+    }
+    if (!lockItem(tid, did, mode, trace)) return refuse(did);
+    if (nested && escalationThreshold > 0) escalate(tid, did, trace);
+    return true;
+}
+
+bool LockManager::planLock(int tid, int did, LockMode mode, Trace& trace, std::vector<int>& missing, bool& nested) {
+    std::shared_lock<std::shared_mutex> registry(registryMutex);
+    if (!validTransaction(tid) || !validItem(did) || itemParent[did] == -1) return false;
+    nested = true;
+    std::vector<int> path;
+    for (int p = itemParent[did]; p != -1; p = itemParent[p]) path.push_back(p);
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        std::lock_guard<std::mutex> guard(stripeFor(*it).mutex);
+        if (!itemHolders[*it].contains(tid)) {
+            missing.push_back(*it);
+            continue;
+        }
+        LockMode held = heldMode(tid, *it);
+        if (lockModeCoversDescendants(held, mode)) {
+            std::lock_guard<std::mutex> latch(latchFor(tid));
+            // Below an escalated lock, remember the item so that
+            // releasing it one by one still works
+            if (coverageOf(tid, *it)) {
+                for (int item = did; item != *it; item = itemParent[item]) {
+                    coverageFor(tid, itemParent[item]).insert(item);
+                }
+            }
+            Event covered(EventType::Covered, tid, did);
+            covered.mode = mode;
+            covered.value = *it;
+            emit(trace, covered);
+            return true;
+        }
+        if (!lockModeCovers(held, intentionFor(mode))) missing.push_back(*it);
     }
-    if (std::find(dataItems.begin(), dataItems.end(), did) == dataItems.end()) {
-        log = "Data item D" + std::to_string(did) + " does not exist";
+    return false;
+}
+
+bool LockManager::lockItem(int tid, int did, LockMode mode, Trace& trace) {
+    for (;;) {
+        std::vector<int> conflicts;
+        Attempt attempt = attemptLock(tid, did, mode, trace, conflicts);
+        if (attempt == Attempt::Granted || attempt == Attempt::Refused) return attempt == Attempt::Granted;
+        if (!resolveConflicts(tid, did, attempt, conflicts, trace)) return false;
+    }
+}
+
+bool LockManager::resolveConflicts(int tid, int did, Attempt attempt, std::vector<int>& conflicts, Trace& trace) {
+    // Aborting needs the whole table; the request was never queued, so
+    // nothing is lost if the state moves on before the registry is ours.
+    std::unique_lock<std::shared_mutex> registry(registryMutex);
+    if (attempt == Attempt::Die) {
+        std::sort(conflicts.begin(), conflicts.end());
+        emit(trace, Event(EventType::WaitDieAborted, tid, did).withIds(conflicts));
+        lockMetrics.add(Counter::WaitDieAborts);
+        if (validTransaction(tid)) terminate(tid, trace);
         return false;
     }
+    std::vector<int> wounded;
+    for (int other : conflicts) {
+        if (validTransaction(other)) wounded.push_back(other);
+    }
+    std::sort(wounded.begin(), wounded.end());
+    if (!wounded.empty()) emit(trace, Event(EventType::Wounded, tid, did).withIds(wounded));
+    lockMetrics.add(Counter::Wounds, wounded.size());
+    // Back of the queue first, so no victim is handed a lock on the way
+    for (auto it = conflicts.rbegin(); it != conflicts.rend(); ++it) {
+        if (validTransaction(*it)) terminate(*it, trace);
+    }
+    return true;
+}
+
+void LockManager::requestLockAsync(int tid, int did, LockMode mode, std::chrono::milliseconds timeout,
+                                   std::function<void(LockOutcome)> done) {
+    lockMetrics.add(Counter::Requests);
+    {
+        std::lock_guard<std::mutex> lock(asyncMutex);
+        if (!asyncThread.joinable()) asyncThread = std::thread(&LockManager::runAsync, this);
+    }
+    auto request = std::make_shared<AsyncRequest>();
+    request->tid = tid;
+    request->did = did;
+    request->mode = mode;
+    request->done = std::move(done);
+    request->timed = timeout > std::chrono::milliseconds::zero();
+    request->deadline = std::chrono::steady_clock::now() + timeout;
+    Trace trace;
+    bool valid;
+    {
+        std::shared_lock<std::shared_mutex> registry(registryMutex);
+        valid = validTransaction(tid);
+    }
+    if (!valid) {
+        // Refused, not Aborted: a stale TID was never this request's to lose
+        emit(trace, Event(EventType::InvalidTransaction, tid));
+        request->finished = true;
+        completeAsync(request, LockOutcome::Refused);
+        return;
+    }
+    if (planLock(tid, did, mode, trace, request->targets, request->nested)) {
+        request->finished = true;
+        completeAsync(request, LockOutcome::Granted);
+        return;
+    }
+    request->targets.push_back(did);
+    stepAsync(request);
+}
+
+std::future<LockOutcome> LockManager::requestLockAsync(int tid, int did, LockMode mode,
+                                                       std::chrono::milliseconds timeout) {
+    auto promise = std::make_shared<std::promise<LockOutcome>>();
+    std::future<LockOutcome> future = promise->get_future();
+    requestLockAsync(tid, did, mode, timeout, [promise](LockOutcome outcome) { promise->set_value(outcome); });
+    return future;
+}
+
+void LockManager::stepAsync(const std::shared_ptr<AsyncRequest>& request) {
+    Trace trace;
+    int tid = request->tid;
+    auto finish = [&](LockOutcome outcome) {
+        if (outcome != LockOutcome::TimedOut) {
+            // A transaction terminated while the request was in flight was aborted
+            std::shared_lock<std::shared_mutex> registry(registryMutex);
+            if (!validTransaction(tid)) outcome = LockOutcome::Aborted;
+        }
+        if (!request->finished.exchange(true)) completeAsync(request, outcome);
+    };
+    while (request->next < request->targets.size()) {
+        int target = request->targets[request->next];
+        if (request->timed && std::chrono::steady_clock::now() >= request->deadline) {
+            emit(trace, Event(EventType::TimedOut, tid, target));
+            lockMetrics.add(Counter::Timeouts);
+            return finish(LockOutcome::TimedOut);
+        }
+        LockMode mode = target == request->did ? request->mode : intentionFor(request->mode);
+        std::vector<int> conflicts;
+        Attempt attempt = attemptLock(tid, target, mode, trace, conflicts, request);
+        if (attempt == Attempt::Granted) {
+            ++request->next;
+            continue;
+        }
+        if (attempt == Attempt::Queued) {
+            // The request may already be granted and stepping on the async
+            // thread, so only its fixed fields are read from here on
+            if (request->timed) {
+                std::lock_guard<std::mutex> lock(asyncMutex);
+                asyncTimers.push(AsyncTimer{request->deadline, request});
+                asyncWake.notify_all();
+            }
+            return;
+        }
+        if (attempt == Attempt::Refused || !resolveConflicts(tid, target, attempt, conflicts, trace)) {
+            return finish(LockOutcome::Refused);
+        }
+    }
+    if (request->nested && escalationThreshold > 0) escalate(tid, request->did, trace);
+    finish(LockOutcome::Granted);
+}
+
+void LockManager::completeAsync(const std::shared_ptr<AsyncRequest>& request, LockOutcome outcome) {
+    size_t next = request->next;
+    if (outcome != LockOutcome::Granted && next > 0 && next < request->targets.size()) {
+        // Intention locks taken on the way are only kept for a granted request
+        Trace trace;
+        std::shared_lock<std::shared_mutex> registry(registryMutex);
+        if (validTransaction(request->tid)) releaseUnneeded(request->tid, request->targets[next], trace);
+    }
+    request->done(outcome);
+}
+
+void LockManager::postCompletion(const std::shared_ptr<AsyncRequest>& request, LockOutcome outcome) {
+    if (request->finished.exchange(true)) return;
+    std::lock_guard<std::mutex> lock(asyncMutex);
+    asyncTasks.push_back(AsyncTask{request, true, outcome});
+    asyncWake.notify_all();
+}
+
+void LockManager::postStep(const std::shared_ptr<AsyncRequest>& request) {
+    std::lock_guard<std::mutex> lock(asyncMutex);
+    asyncTasks.push_back(AsyncTask{request, false, LockOutcome::Granted});
+    asyncWake.notify_all();
+}
+
+void LockManager::expireAsync(const std::shared_ptr<AsyncRequest>& request) {
+    Trace trace;
+    int tid = request->tid;
+    {
+        std::shared_lock<std::shared_mutex> registry(registryMutex);
+        size_t next = request->next;
+        if (next >= request->targets.size()) return;
+        int did = request->targets[next];
+        // Only a request still queued is withdrawn; one between steps checks
+        // its deadline when the next step runs
+        std::lock_guard<std::mutex> guard(stripeFor(did).mutex);
+        auto& queue = itemQueue[did];
+        auto it = std::find_if(queue.begin(), queue.end(), [&](const LockRequest& r) { return r.async == request; });
+        if (it == queue.end() || request->finished.exchange(true)) return;
+        {
+            std::lock_guard<std::mutex> latch(latchFor(tid));
+            txWaiting[slotOf(tid)].erase(did);
+            if (txWaiting[slotOf(tid)].empty()) txDeadlockedSince[slotOf(tid)] = {};
+            markTransaction(tid);
+        }
+        auto before = itemEdges(did);
+        queue.erase(it);
+        --queuedRequests;
+        std::vector<int> granted = grantWaiters(did);
+        std::vector<std::vector<int>> cycles = relinkItem(did, before);
+        emit(trace, Event(EventType::TimedOut, tid, did));
+        emitGrants(trace, granted, did);
+        settleCycles(did, cycles, trace);
+        wakeWaiters(did);
+    }
+    lockMetrics.add(Counter::Timeouts);
+    completeAsync(request, LockOutcome::TimedOut);
+}
+
+void LockManager::runAsync() {
+    std::unique_lock<std::mutex> lock(asyncMutex);
+    while (!asyncStopping) {
+        if (!asyncTasks.empty()) {
+            AsyncTask task = std::move(asyncTasks.front());
+            asyncTasks.pop_front();
+            lock.unlock();
+            if (task.complete) {
+                completeAsync(task.request, task.outcome);
+            } else {
+                stepAsync(task.request);
+            }
+            lock.lock();
+            continue;
+        }
+        if (!asyncTimers.empty() && asyncTimers.top().deadline <= std::chrono::steady_clock::now()) {
+            std::shared_ptr<AsyncRequest> request = asyncTimers.top().request.lock();
+            asyncTimers.pop();
+            if (!request || request->finished) continue;
+            lock.unlock();
+            expireAsync(request);
+            lock.lock();
+            continue;
+        }
+        if (asyncTimers.empty()) {
+            asyncWake.wait(lock);
+        } else {
+            asyncWake.wait_until(lock, asyncTimers.top().deadline);
+        }
+    }
+}
+
+bool LockManager::requestLocks(int tid, const std::vector<int>& dids, LockMode mode, std::string& log) {
+    std::vector<Event> events;
+    Trace trace{&events};
+    bool granted = requestLocks(tid, dids, mode, trace);
+    log = formatEvents(events);
+    return granted;
+}
 
-    auto& T = transactions[tid];
-    if (preventionEnabled && !T.heldLocks.empty()) {
-        int maxHeld = *std::max_element(T.heldLocks.begin(), T.heldLocks.end());
-        if (did <= maxHeld) {
-            log = "Request denied: T" + std::to_string(tid) + " cannot request D" +
-                  std::to_string(did) + " (holds D" + std::to_string(maxHeld) + ")";
+bool LockManager::requestLocks(int tid, const std::vector<int>& dids, LockMode mode, Trace& trace) {
+    std::vector<int> items(dids);
+    std::sort(items.begin(), items.end());
+    items.erase(std::unique(items.begin(), items.end()), items.end());
+    lockMetrics.add(Counter::Requests, items.size());
+    // The items and their ancestors' intention locks, by DID; a parent that
+    // is also requested itself gets the mode covering both
+    std::vector<std::pair<int, LockMode>> wanted;
+    std::vector<int> nested; // one item below each parent, for escalation
+    {
+        std::shared_lock<std::shared_mutex> registry(registryMutex);
+        if (!validTransaction(tid)) {
+            emit(trace, Event(EventType::InvalidTransaction, tid));
             return false;
         }
+        for (int did : items) {
+            if (!validItem(did)) {
+                emit(trace, Event(EventType::NoSuchItem, -1, did));
+                return false;
+            }
+            wanted.push_back({did, mode});
+            for (int p = itemParent[did]; p != -1; p = itemParent[p]) wanted.push_back({p, intentionFor(mode)});
+            if (itemParent[did] != -1) nested.push_back(did);
+        }
+        std::sort(wanted.begin(), wanted.end(),
+                  [](const std::pair<int, LockMode>& a, const std::pair<int, LockMode>& b) { return a.first < b.first; });
+        size_t merged = 0;
+        for (size_t i = 0; i < wanted.size(); ++i) {
+            if (merged > 0 && wanted[merged - 1].first == wanted[i].first) {
+                wanted[merged - 1].second = lockModeSupremum(wanted[merged - 1].second, wanted[i].second);
+            } else {
+                wanted[merged++] = wanted[i];
+            }
+        }
+        wanted.resize(merged);
+
+        std::lock_guard<std::mutex> latch(latchFor(tid));
+        const IdSet& held = txHeld[slotOf(tid)];
+        for (const auto& w : wanted) {
+            if (txWaiting[slotOf(tid)].contains(w.first)) {
+                emit(trace, Event(EventType::AlreadyWaiting, tid, w.first));
+                return false;
+            }
+            if (preventionMode == PreventionMode::Avoidance && !claimCovers(tid, w.first, w.second)) {
+                Event exceeded(EventType::ClaimExceeded, tid, w.first);
+                exceeded.mode = w.second;
+                emit(trace, exceeded);
+                return false;
+            }
+            if (preventionMode == PreventionMode::LockOrdering && !held.empty() && !held.contains(w.first) &&
+                w.first <= held.max()) {
+                Event denied(EventType::OrderingDenied, tid, w.first);
+                denied.value = held.max();
+                emit(trace, denied);
+                lockMetrics.add(Counter::OrderingDenials);
+                return false;
+            }
+        }
     }
 
-    auto it = lockTable.find(did);
-    if (it->second == -1) { // Lock is free
-        lockTable[did] = tid;
-        T.heldLocks.insert(did);
-        log = "T" + std::to_string(tid) + " acquired lock on D" + std::to_string(did);
-        return true;
-    } else {
-        T.waitingFor.insert(did);
-        log = "T" + std::to_string(tid) + " waiting for D" + std::to_string(did) +
-              " held by T" + std::to_string(it->second);
+    std::vector<std::pair<int, int>> taken; // what this call granted, with the mode held before or -1
+    size_t next = 0;
+    for (;;) {
+        {
+            std::shared_lock<std::shared_mutex> registry(registryMutex);
+            if (!validTransaction(tid)) {
+                emit(trace, Event(EventType::InvalidTransaction, tid));
+                return false;
+            }
+            if (grantBatch(tid, wanted, next, blocking, taken, trace)) break;
+            if (!blocking) return false;
+        }
+        // Wait for the first item that is not free; everything before it is held
+        int did = wanted[next].first;
+        int before = -1;
+        {
+            std::shared_lock<std::shared_mutex> registry(registryMutex);
+            std::lock_guard<std::mutex> guard(stripeFor(did).mutex);
+            if (itemHolders[did].contains(tid)) before = static_cast<int>(heldMode(tid, did));
+        }
+        if (lockItem(tid, did, wanted[next].second, trace)) {
+            taken.push_back({did, before});
+            ++next;
+            continue;
+        }
+        std::shared_lock<std::shared_mutex> registry(registryMutex);
+        if (!validTransaction(tid)) return false; // terminated, nothing left to undo
+        withdrawRequest(tid, did, trace);
+        for (auto it = taken.rbegin(); it != taken.rend(); ++it) {
+            if (it->second == -1) {
+                releaseItem(tid, it->first, trace, true);
+            } else {
+                restoreMode(tid, it->first, static_cast<LockMode>(it->second), trace);
+            }
+        }
         return false;
     }
+    if (escalationThreshold > 0) {
+        for (int did : nested) escalate(tid, did, trace);
+    }
+    return true;
+}
+
+bool LockManager::grantBatch(int tid, const std::vector<std::pair<int, LockMode>>& wanted, size_t& next,
+                             bool partial, std::vector<std::pair<int, int>>& taken, Trace& trace) {
+    // The only place holding several stripes: always in index order. Earlier
+    // entries are locked too, as they are the ancestors `covered` reads.
+    std::vector<int> stripeIds;
+    for (const auto& w : wanted) stripeIds.push_back(w.first % kLockStripes);
+    std::sort(stripeIds.begin(), stripeIds.end());
+    stripeIds.erase(std::unique(stripeIds.begin(), stripeIds.end()), stripeIds.end());
+    std::vector<std::unique_lock<std::mutex>> guards;
+    for (int i : stripeIds) guards.emplace_back(stripes[i].mutex);
+
+    // Held entries, or ones covered by a lock on an ancestor, need nothing.
+    // Returns the entry itself or that ancestor, else -1.
+    auto coveredBy = [&](int did, LockMode mode) {
+        if (holdsAtLeast(tid, did, mode)) return did;
+        for (int p = itemParent[did]; p != -1; p = itemParent[p]) {
+            if (itemHolders[p].contains(tid) && lockModeCoversDescendants(heldMode(tid, p), mode)) return p;
+        }
+        return -1;
+    };
+    size_t end = next;
+    for (; end < wanted.size(); ++end) {
+        int did = wanted[end].first;
+        if (coveredBy(did, wanted[end].second) != -1) continue;
+        bool upgrade = itemHolders[did].contains(tid);
+        bool grantable;
+        if (upgrade) {
+            grantable = std::none_of(itemQueue[did].begin(), itemQueue[did].end(),
+                                     [](const LockRequest& r) { return r.upgrade; }) &&
+                        compatibleWithOthers(did, tid, lockModeSupremum(heldMode(tid, did), wanted[end].second));
+        } else {
+            grantable = itemQueue[did].empty() &&
+                        (itemHolders[did].empty() || lockModesCompatible(itemMode[did], wanted[end].second));
+        }
+        if (!grantable) break;
+    }
+    if (end < wanted.size() && !partial) {
+        int did = wanted[end].first;
+        std::vector<int> blockers = blockersOf(tid, did, wanted[end].second, itemHolders[did].contains(tid));
+        std::sort(blockers.begin(), blockers.end());
+        Event unavailable(EventType::BatchUnavailable, tid, did);
+        unavailable.value = static_cast<int>(wanted.size());
+        emit(trace, unavailable.withIds(blockers));
+        next = end;
+        return false;
+    }
+    // Claim edges for everything granted below go in together
+    std::vector<std::pair<int, LockMode>> grants;
+    for (size_t i = next; i < end; ++i) {
+        int did = wanted[i].first;
+        if (itemClaims[did].empty() || coveredBy(did, wanted[i].second) != -1) continue;
+        bool upgrade = itemHolders[did].contains(tid);
+        grants.push_back({did, upgrade ? lockModeSupremum(heldMode(tid, did), wanted[i].second) : wanted[i].second});
+    }
+    int reached = grants.empty() ? -1 : claimGrants(tid, grants);
+    if (reached != -1) {
+        if (partial) return false; // item by item instead, each deferred until it is safe
+        // Nothing waits here, so an unsafe batch is as unavailable as a held one
+        auto unsafe = std::find_if(grants.begin(), grants.end(), [&](const std::pair<int, LockMode>& g) {
+            return claimConflicts(g.first, reached, g.second);
+        });
+        Event unavailable(EventType::BatchUnavailable, tid, unsafe->first);
+        unavailable.value = static_cast<int>(wanted.size());
+        emit(trace, unavailable.withIds(std::vector<int>{reached}));
+        return false;
+    }
+    for (; next < end; ++next) {
+        int did = wanted[next].first;
+        int cover = coveredBy(did, wanted[next].second);
+        if (cover != -1) {
+            // Ancestors' intention locks are bookkeeping, not worth a line
+            if (isIntentionMode(wanted[next].second)) continue;
+            Event holds(cover == did ? EventType::AlreadyHolds : EventType::Covered, tid, did);
+            holds.mode = wanted[next].second;
+            holds.value = cover;
+            emit(trace, holds);
+            continue;
+        }
+        bool upgrade = itemHolders[did].contains(tid);
+        LockMode mode = upgrade ? lockModeSupremum(heldMode(tid, did), wanted[next].second) : wanted[next].second;
+        taken.push_back({did, upgrade ? static_cast<int>(heldMode(tid, did)) : -1});
+        auto before = itemEdges(did);
+        setHolder(did, tid, mode, !itemClaims[did].empty());
+        markItem(did);
+        {
+            std::lock_guard<std::mutex> latch(latchFor(tid));
+            if (txHeld[slotOf(tid)].insert(did)) countChild(tid, did, 1);
+            markTransaction(tid);
+            ++txWork[slotOf(tid)];
+        }
+        std::vector<std::vector<int>> cycles = relinkItem(did, before);
+        Event outcome(upgrade ? EventType::Upgraded : EventType::Acquired, tid, did);
+        outcome.mode = mode;
+        emit(trace, outcome);
+        lockMetrics.add(Counter::Granted);
+        settleCycles(did, cycles, trace);
+    }
+    return next == wanted.size();
+}
+
+void LockManager::restoreMode(int tid, int did, LockMode mode, Trace& trace) {
+    {
+        std::lock_guard<std::mutex> guard(stripeFor(did).mutex);
+        if (!itemHolders[did].contains(tid)) return;
+        auto before = itemEdges(did);
+        setHolder(did, tid, mode);
+        markItem(did);
+        std::vector<int> granted = grantWaiters(did);
+        std::vector<std::vector<int>> cycles = relinkItem(did, before);
+        emitGrants(trace, granted, did);
+        settleCycles(did, cycles, trace);
+        wakeWaiters(did);
+    }
+    grantDeferred(trace);
+}
+
+LockManager::Attempt LockManager::attemptLock(int tid, int did, LockMode mode, Trace& trace,
+                                              std::vector<int>& conflicts,
+                                              const std::shared_ptr<AsyncRequest>& async) {
+    std::shared_lock<std::shared_mutex> registry(registryMutex);
+    if (!validTransaction(tid)) {
+        emit(trace, Event(EventType::InvalidTransaction, tid));
+        return Attempt::Refused;
+    }
+    if (!validItem(did)) {
+        emit(trace, Event(EventType::NoSuchItem, -1, did));
+        return Attempt::Refused;
+    }
+
+    PreventionMode prevention = preventionMode;
+    if (prevention == PreventionMode::Avoidance && !claimCovers(tid, did, mode)) {
+        Event exceeded(EventType::ClaimExceeded, tid, did);
+        exceeded.mode = mode;
+        emit(trace, exceeded);
+        return Attempt::Refused;
+    }
+    if (prevention == PreventionMode::LockOrdering) {
+        std::lock_guard<std::mutex> latch(latchFor(tid));
+        const IdSet& held = txHeld[slotOf(tid)];
+        if (!held.empty() && !held.contains(did) && did <= held.max()) {
+            Event denied(EventType::OrderingDenied, tid, did);
+            denied.value = held.max();
+            emit(trace, denied);
+            lockMetrics.add(Counter::OrderingDenials);
+            return Attempt::Refused;
+        }
+    }
+
+    LockStripe& stripe = stripeFor(did);
+    std::unique_lock<std::mutex> guard(stripe.mutex);
+    if (holdsAtLeast(tid, did, mode)) {
+        Event holds(EventType::AlreadyHolds, tid, did);
+        holds.mode = mode;
+        emit(trace, holds);
+        return Attempt::Granted;
+    }
+    {
+        std::lock_guard<std::mutex> latch(latchFor(tid));
+        if (txWaiting[slotOf(tid)].contains(did)) {
+            emit(trace, Event(EventType::AlreadyWaiting, tid, did));
+            return Attempt::Refused;
+        }
+    }
+
+    bool upgrade = itemHolders[did].contains(tid);
+    LockMode wanted = upgrade ? lockModeSupremum(heldMode(tid, did), mode) : mode;
+    if (prevention == PreventionMode::WaitDie || prevention == PreventionMode::WoundWait) {
+        // Only waits from older to younger (wait-die) or younger to older
+        // (wound-wait) are allowed, so the wait-for graph cannot close a cycle.
+        for (int other : blockersOf(tid, did, wanted, upgrade)) {
+            bool older = txStart[slotOf(other)] < txStart[slotOf(tid)];
+            if (older == (prevention == PreventionMode::WaitDie)) conflicts.push_back(other);
+        }
+        if (!conflicts.empty()) return prevention == PreventionMode::WaitDie ? Attempt::Die : Attempt::Wound;
+    }
+    {
+        std::lock_guard<std::mutex> latch(latchFor(tid));
+        txWaiting[slotOf(tid)].insert(did);
+        markTransaction(tid);
+    }
+
+    auto before = itemEdges(did);
+    auto& queue = itemQueue[did];
+    if (upgrade) {
+        auto pos = std::find_if(queue.begin(), queue.end(), [](const LockRequest& r) { return !r.upgrade; });
+        queue.insert(pos, LockRequest{tid, wanted, true, 0, nullptr, -1});
+    } else {
+        queue.push_back(LockRequest{tid, wanted, false, 0, nullptr, -1});
+    }
+    ++queuedRequests;
+    std::vector<int> granted = grantWaiters(did, tid);
+    std::vector<std::vector<int>> cycles = relinkItem(did, before);
+
+    bool acquired = std::find(granted.begin(), granted.end(), tid) != granted.end();
+    int unsafeWith = -1;
+    if (acquired) {
+        lockMetrics.add(Counter::Granted);
+    } else {
+        lockMetrics.add(Counter::Waited);
+        itemWaits[did].fetch_add(1, std::memory_order_relaxed);
+        for (LockRequest& r : queue) {
+            if (r.tid != tid) continue;
+            r.waitingSince = nowNs();
+            r.async = async;
+            unsafeWith = r.unsafeWith;
+        }
+    }
+    Event outcome(acquired ? (upgrade ? EventType::Upgraded : EventType::Acquired) : EventType::Waiting, tid, did);
+    outcome.mode = wanted;
+    if (unsafeWith != -1) {
+        outcome.type = EventType::UnsafeDeferred;
+        outcome.value = unsafeWith;
+    } else if (!acquired) {
+        std::vector<int> others;
+        for (int h : itemHolders[did]) {
+            if (h != tid) others.push_back(h);
+        }
+        outcome.withIds(others);
+    }
+    emit(trace, outcome);
+    // A deferred request ahead may have turned safe and been granted too
+    granted.erase(std::remove(granted.begin(), granted.end(), tid), granted.end());
+    if (!granted.empty()) {
+        emitGrants(trace, granted, did);
+        wakeWaiters(did);
+    }
+    settleCycles(did, cycles, trace);
+    if (acquired) return Attempt::Granted;
+    if (async) return Attempt::Queued;
+    if (!blocking) return Attempt::Refused;
+
+    for (;;) {
+        bool waiting;
+        {
+            std::lock_guard<std::mutex> latch(latchFor(tid));
+            waiting = txWaiting[slotOf(tid)].contains(did);
+        }
+        if (!waiting) {
+            Event outcome(holdsAtLeast(tid, did, mode) ? EventType::Acquired : EventType::WouldCloseDeadlock, tid, did);
+            outcome.mode = mode;
+            emit(trace, outcome);
+            return outcome.type == EventType::Acquired ? Attempt::Granted : Attempt::Refused;
+        }
+        // Park without holding the registry so detection and recovery can run
+        unsigned long seen = stripe.version;
+        registry.unlock();
+        stripe.released.wait(guard, [&] { return stripe.version != seen; });
+        guard.unlock();
+        registry.lock();
+        guard.lock();
+        // Re-indexed every pass: the tables may grow while this thread is parked
+        if (!validTransaction(tid)) {
+            emit(trace, Event(EventType::TerminatedWhileWaiting, tid, did));
+            return Attempt::Refused;
+        }
+    }
 }
 
 void LockManager::releaseLock(int tid, int did, std::string& log) {
-    if (tid >= static_cast<int>(transactions.size()) || !transactions[tid].active) {
-        log = "Invalid or inactive transaction T" + std::to_string(tid);
+    std::vector<Event> events;
+    Trace trace{&events};
+    releaseLock(tid, did, trace);
+    log = formatEvents(events);
+}
+
+void LockManager::releaseLock(int tid, int did, Trace& trace) {
+    std::shared_lock<std::shared_mutex> registry(registryMutex);
+    if (!validTransaction(tid)) {
+        emit(trace, Event(EventType::InvalidTransaction, tid));
         return;
     }
-    auto& T = transactions[tid];
-    if (T.heldLocks.find(did) != T.heldLocks.end()) {
-        T.heldLocks.erase(did);
-        lockTable[did] = -1;
-        log = "T" + std::to_string(tid) + " released lock on D" + std::to_string(did);
-    } else {
-        log = "T" + std::to_string(tid) + " does not hold D" + std::to_string(did);
+    if (!validItem(did)) {
+        emit(trace, Event(EventType::NoSuchItem, -1, did));
+        return;
+    }
+    if (itemChildCount[did] > 0) {
+        // Everything below goes first, deepest items before their parents
+        std::vector<std::pair<int, int>> below, queued; // (depth, DID)
+        {
+            std::lock_guard<std::mutex> latch(latchFor(tid));
+            auto depthBelow = [&](int item) {
+                int depth = 0;
+                for (int p = itemParent[item]; p != -1; p = itemParent[p]) {
+                    ++depth;
+                    if (p == did) return depth;
+                }
+                return 0;
+            };
+            for (int item : txHeld[slotOf(tid)]) {
+                if (int depth = depthBelow(item)) below.push_back({depth, item});
+            }
+            for (int item : txWaiting[slotOf(tid)]) {
+                if (depthBelow(item) && !txHeld[slotOf(tid)].contains(item)) queued.push_back({0, item});
+            }
+            dropCoverage(tid, did);
+        }
+        std::sort(below.rbegin(), below.rend());
+        for (const auto& q : queued) withdrawRequest(tid, q.second, trace);
+        for (const auto& b : below) releaseItem(tid, b.second, trace, true);
+    }
+    if (releaseItem(tid, did, trace, true)) {
+        releaseUnneeded(tid, did, trace);
+        return;
+    }
+    {
+        // Not held itself, but maybe through an escalated lock above it
+        std::lock_guard<std::mutex> latch(latchFor(tid));
+        IdSet* covered = itemParent[did] == -1 ? nullptr : coverageOf(tid, itemParent[did]);
+        if (!covered || !covered->erase(did)) {
+            emit(trace, Event(EventType::NotHeld, tid, did));
+            return;
+        }
+    }
+    Event released(EventType::Released, tid, did);
+    lockMetrics.add(Counter::Released);
+    emit(trace, released);
+    releaseUnneeded(tid, did, trace);
+}
+
+bool LockManager::releaseItem(int tid, int did, Trace& trace, bool report) {
+    {
+        std::lock_guard<std::mutex> guard(stripeFor(did).mutex);
+        {
+            std::lock_guard<std::mutex> latch(latchFor(tid));
+            if (!txHeld[slotOf(tid)].erase(did)) return false;
+            countChild(tid, did, -1);
+            txWaiting[slotOf(tid)].erase(did); // a pending upgrade goes away with the lock
+            markTransaction(tid);
+        }
+        auto before = itemEdges(did);
+        Event released(EventType::Released, tid, did);
+        released.mode = heldMode(tid, did);
+        dropHolder(did, tid);
+        markItem(did);
+        removeRequest(tid, did);
+        std::vector<int> granted = grantWaiters(did);
+        std::vector<std::vector<int>> cycles = relinkItem(did, before);
+        if (report) emit(trace, released);
+        lockMetrics.add(Counter::Released);
+        emitGrants(trace, granted, did);
+        settleCycles(did, cycles, trace);
+        wakeWaiters(did);
+    }
+    grantDeferred(trace);
+    return true;
+}
+
+void LockManager::withdrawRequest(int tid, int did, Trace& trace) {
+    std::lock_guard<std::mutex> guard(stripeFor(did).mutex);
+    {
+        std::lock_guard<std::mutex> latch(latchFor(tid));
+        if (!txWaiting[slotOf(tid)].erase(did)) return;
+        markTransaction(tid);
+    }
+    auto before = itemEdges(did);
+    removeRequest(tid, did);
+    std::vector<int> granted = grantWaiters(did);
+    std::vector<std::vector<int>> cycles = relinkItem(did, before);
+    emitGrants(trace, granted, did);
+    settleCycles(did, cycles, trace);
+    wakeWaiters(did);
+}
+
+void LockManager::releaseUnneeded(int tid, int did, Trace& trace) {
+    for (int p = itemParent[did]; p != -1; p = itemParent[p]) {
+        bool held, escalated;
+        {
+            std::lock_guard<std::mutex> guard(stripeFor(p).mutex);
+            std::lock_guard<std::mutex> latch(latchFor(tid));
+            if (childLocks(tid, p) > 0 || txWaiting[slotOf(tid)].contains(p)) return;
+            for (int item : txWaiting[slotOf(tid)]) {
+                if (itemParent[item] == p) return;
+            }
+            IdSet* covered = coverageOf(tid, p);
+            if (covered && !covered->empty()) return;
+            held = itemHolders[p].contains(tid);
+            escalated = covered != nullptr;
+            // A lock asked for in its own right stays
+            if (held && !escalated && !isIntentionMode(heldMode(tid, p))) return;
+            if (!held && !escalated) return;
+            dropCoverage(tid, p);
+            if (!held) {
+                // Held through an escalated lock further up
+                IdSet* above = itemParent[p] == -1 ? nullptr : coverageOf(tid, itemParent[p]);
+                if (above) above->erase(p);
+            }
+        }
+        if (held) releaseItem(tid, p, trace, true);
     }
 }
 
+void LockManager::escalate(int tid, int did, Trace& trace) {
+    std::shared_lock<std::shared_mutex> registry(registryMutex);
+    int threshold = escalationThreshold;
+    int parent = itemParent[did];
+    if (!validTransaction(tid) || parent == -1 || threshold <= 0) return;
+    std::vector<std::pair<int, int>> below; // (depth, DID) of every lock under the parent
+    {
+        std::lock_guard<std::mutex> latch(latchFor(tid));
+        if (childLocks(tid, parent) < threshold) return;
+        auto depthBelow = [&](int item) {
+            int depth = 0;
+            for (int p = itemParent[item]; p != -1; p = itemParent[p]) {
+                ++depth;
+                if (p == parent) return depth;
+            }
+            return 0;
+        };
+        for (int item : txWaiting[slotOf(tid)]) {
+            if (item == parent || depthBelow(item)) return; // not while a request there is queued
+        }
+        for (int item : txHeld[slotOf(tid)]) {
+            if (int depth = depthBelow(item)) below.push_back({depth, item});
+        }
+    }
+    bool writes = false;
+    for (const auto& b : below) {
+        std::lock_guard<std::mutex> guard(stripeFor(b.second).mutex);
+        LockMode held = heldMode(tid, b.second);
+        writes = writes || (held != LockMode::Shared && held != LockMode::IntentionShared);
+    }
+    {
+        std::lock_guard<std::mutex> guard(stripeFor(parent).mutex);
+        if (!itemHolders[parent].contains(tid)) return;
+        LockMode mode = lockModeSupremum(heldMode(tid, parent), writes ? LockMode::Exclusive : LockMode::Shared);
+        // Only if it is free right now: waiting here could deadlock with
+        // transactions working on other items below the parent
+        for (const LockRequest& r : itemQueue[parent]) {
+            if (r.upgrade) return;
+        }
+        if (!compatibleWithOthers(parent, tid, mode)) return;
+        bool claims = !itemClaims[parent].empty();
+        if (preventionMode == PreventionMode::Avoidance && !claimCovers(tid, parent, mode)) return;
+        if (claims && claimGrants(tid, {{parent, mode}}) != -1) return;
+        auto before = itemEdges(parent);
+        setHolder(parent, tid, mode, claims);
+        markItem(parent);
+        std::vector<std::vector<int>> cycles = relinkItem(parent, before);
+        {
+            std::lock_guard<std::mutex> latch(latchFor(tid));
+            markTransaction(tid);
+            for (const auto& b : below) {
+                for (int item = b.second; item != parent; item = itemParent[item]) {
+                    coverageFor(tid, itemParent[item]).insert(item);
+                }
+            }
+        }
+        Event escalated(EventType::Escalated, tid, parent);
+        escalated.mode = mode;
+        escalated.value = static_cast<int>(below.size());
+        emit(trace, escalated);
+        lockMetrics.add(Counter::Escalations);
+        settleCycles(parent, cycles, trace);
+    }
+    std::sort(below.rbegin(), below.rend());
+    for (const auto& b : below) releaseItem(tid, b.second, trace, false);
+}
+
 bool LockManager::detectDeadlock(std::string& log, std::vector<int>& cycle) {
+    std::vector<Event> events;
+    Trace trace{&events};
+    bool found = detectDeadlock(trace, cycle);
+    log = formatEvents(events);
+    return found;
+}
+
+bool LockManager::detectDeadlock(Trace& trace, std::vector<int>& cycle) {
+    std::unique_lock<std::shared_mutex> registry(registryMutex);
+    std::int64_t began = nowNs();
     cycle = findCycle();
+    lockMetrics.recordDetection(nowNs() - began);
+    lockMetrics.add(Counter::DetectionPasses);
     if (!cycle.empty()) {
-        std::stringstream ss;
-        ss << "Deadlock detected: ";
-        for (size_t i = 0; i < cycle.size(); ++i) {
-            ss << "T" << cycle[i];
-            if (i < cycle.size() - 1) ss << " -> ";
-        }
-        log = ss.str();
+        lockMetrics.add(Counter::DeadlocksDetected);
+        lockMetrics.recordCycle(cycle.size() - 1);
+        emit(trace, Event(EventType::DeadlockDetected).withIds(cycle));
         return true;
     }
-    log = "No deadlock detected";
+    emit(trace, Event(EventType::NoDeadlock));
     return false;
 }
 
 void LockManager::recover(const std::vector<int>& cycle, std::string& log) {
+    std::vector<Event> events;
+    Trace trace{&events};
+    recover(cycle, trace);
+    log = formatEvents(events);
+}
+
+void LockManager::recover(const std::vector<int>& cycle, Trace& trace) {
     if (cycle.empty()) {
-        log = "No deadlock to recover from";
+        emit(trace, Event(EventType::NothingToRecover));
         return;
     }
-    int tidToTerminate = *std::max_element(cycle.begin(), cycle.end());
-    auto& T = transactions[tidToTerminate];
-    T.active = false;
-    for (int did : T.heldLocks) {
-        lockTable[did] = -1;
+    std::unique_lock<std::shared_mutex> registry(registryMutex);
+    int tidToTerminate = chooseVictim(cycle);
+    if (tidToTerminate == -1) {
+        emit(trace, Event(EventType::AlreadyResolved));
+        return;
     }
-    T.heldLocks.clear();
-    T.waitingFor.clear();
-    log = "Terminated T" + std::to_string(tidToTerminate) + " to resolve deadlock";
+    emit(trace, Event(EventType::VictimTerminated, tidToTerminate));
+    lockMetrics.add(Counter::Victims);
+    terminate(tidToTerminate, trace);
 }
 
-std::vector<int> LockManager::findCycle() {
-    std::map<int, std::set<int>> waitForGraph;
-    for (const auto& T : transactions) {
-        if (T.active && !T.waitingFor.empty()) {
-            for (int did : T.waitingFor) {
-                auto it = lockTable.find(did);
-                if (it != lockTable.end() && it->second != -1 && it->second != T.id) {
-                    waitForGraph[T.id].insert(it->second);
+bool LockManager::terminateVictim(int tid, std::string& log) {
+    std::vector<Event> events;
+    Trace trace{&events};
+    bool terminated = terminateVictim(tid, trace);
+    log = formatEvents(events);
+    return terminated;
+}
+
+bool LockManager::terminateVictim(int tid, Trace& trace) {
+    std::unique_lock<std::shared_mutex> registry(registryMutex);
+    if (!validTransaction(tid)) {
+        emit(trace, Event(EventType::InvalidTransaction, tid));
+        return false;
+    }
+    emit(trace, Event(EventType::VictimTerminated, tid));
+    lockMetrics.add(Counter::Victims);
+    terminate(tid, trace);
+    return true;
+}
+
+void LockManager::waitForEdges(std::vector<std::pair<int, int>>& edges) {
+    // txTid changes under the exclusive registry lock, not graphMutex
+    std::shared_lock<std::shared_mutex> registry(registryMutex);
+    std::lock_guard<std::mutex> graph(graphMutex);
+    edges = waitForGraph.edges();
+    for (auto& e : edges) e = {txTid[e.first], txTid[e.second]};
+    std::sort(edges.begin(), edges.end());
+}
+
+bool LockManager::detectAllDeadlocks(std::string& log, std::vector<std::vector<int>>& components) {
+    std::vector<Event> events;
+    Trace trace{&events};
+    bool found = detectAllDeadlocks(trace, components);
+    log = formatEvents(events);
+    return found;
+}
+
+bool LockManager::detectAllDeadlocks(Trace& trace, std::vector<std::vector<int>>& components) {
+    std::unique_lock<std::shared_mutex> registry(registryMutex);
+    std::int64_t began = nowNs();
+    components = waitForGraph.deadlockedComponents();
+    for (auto& component : components) {
+        toTids(component);
+        std::sort(component.begin(), component.end());
+    }
+    lockMetrics.recordDetection(nowNs() - began);
+    lockMetrics.add(Counter::DetectionPasses);
+    lockMetrics.add(Counter::DeadlocksDetected, components.size());
+    for (const auto& component : components) lockMetrics.recordCycle(component.size());
+    if (components.empty()) {
+        emit(trace, Event(EventType::NoDeadlock));
+        return false;
+    }
+    Event detected(EventType::GroupsDetected);
+    detected.value = static_cast<int>(components.size());
+    emit(trace, detected);
+    for (const auto& component : components) emit(trace, Event(EventType::Group).withIds(component));
+    return true;
+}
+
+void LockManager::recoverAll(const std::vector<std::vector<int>>& components, std::string& log,
+                             std::vector<int>& victims) {
+    std::vector<Event> events;
+    Trace trace{&events};
+    recoverAll(components, trace, victims);
+    log = formatEvents(events);
+}
+
+void LockManager::recoverAll(const std::vector<std::vector<int>>& components, Trace& trace,
+                             std::vector<int>& victims) {
+    victims.clear();
+    if (components.empty()) {
+        emit(trace, Event(EventType::NothingToRecover));
+        return;
+    }
+    std::unique_lock<std::shared_mutex> registry(registryMutex);
+    // The graph links requests queued behind an exclusive request only to
+    // that request, so a victim set computed on it can leave a cycle that was
+    // hidden behind a victim. Repeat on what is left until no group remains.
+    // The grants are held back until the victims are known and reported.
+    std::vector<Event> grants;
+    trace.held = &grants;
+    // The graph works on slots; TIDs that already ended are left out
+    std::vector<std::vector<int>> groups;
+    for (const auto& component : components) {
+        groups.emplace_back();
+        for (int tid : component) {
+            if (knownTransaction(tid)) groups.back().push_back(slotOf(tid));
+        }
+    }
+    while (!groups.empty()) {
+        for (int slot : waitForGraph.breakingSet(groups, [this](int s) { return victimCost(txTid[s]); },
+                                                 [this](int s) { return txStart[s]; })) {
+            int tid = txTid[slot];
+            if (!validTransaction(tid)) continue;
+            victims.push_back(tid);
+            terminate(tid, trace);
+        }
+        groups = waitForGraph.deadlockedComponents();
+    }
+    trace.held = nullptr;
+    lockMetrics.add(Counter::Victims, victims.size());
+    Event terminated(EventType::VictimsTerminated);
+    terminated.value = static_cast<int>(components.size());
+    emit(trace, terminated.withIds(victims));
+    for (const Event& event : grants) emit(trace, event);
+}
+
+void LockManager::snapshotMetrics(MetricsSnapshot& snapshot, int hottest) {
+    lockMetrics.snapshot(snapshot);
+    // Shared is enough: items are only added under the exclusive lock, and
+    // the counts are atomic
+    std::shared_lock<std::shared_mutex> registry(registryMutex);
+    for (int did = 0; did < nextDid; ++did) {
+        std::uint64_t waits = itemWaits[did].load(std::memory_order_relaxed);
+        if (waits) snapshot.hotItems.push_back({did, waits});
+    }
+    size_t keep = std::min(snapshot.hotItems.size(), static_cast<size_t>(std::max(hottest, 0)));
+    std::partial_sort(snapshot.hotItems.begin(), snapshot.hotItems.begin() + keep, snapshot.hotItems.end(),
+                      [](const std::pair<int, std::uint64_t>& a, const std::pair<int, std::uint64_t>& b) {
+                          return a.second != b.second ? a.second > b.second : a.first < b.first;
+                      });
+    snapshot.hotItems.resize(keep);
+}
+
+bool LockManager::deadlockFormedAt(const std::vector<int>& component, std::chrono::steady_clock::time_point& formed) {
+    std::shared_lock<std::shared_mutex> registry(registryMutex);
+    bool found = false;
+    for (int tid : component) {
+        if (!knownTransaction(tid)) continue;
+        std::lock_guard<std::mutex> latch(latchFor(tid));
+        auto since = txDeadlockedSince[slotOf(tid)];
+        if (since == std::chrono::steady_clock::time_point()) continue;
+        if (!found || since < formed) formed = since;
+        found = true;
+    }
+    return found;
+}
+
+double LockManager::victimCost(int tid) const {
+    double cost = 0;
+    switch (victimPolicy) {
+    case VictimPolicy::Youngest:
+        cost = -static_cast<double>(txStart[slotOf(tid)]);
+        break;
+    case VictimPolicy::FewestLocks:
+        cost = static_cast<double>(txHeld[slotOf(tid)].size());
+        break;
+    case VictimPolicy::LeastWork:
+        cost = txWork[slotOf(tid)];
+        break;
+    case VictimPolicy::WeightedCost:
+        cost = victimWeights.perLockHeld * txHeld[slotOf(tid)].size() + victimWeights.perGrant * txWork[slotOf(tid)] +
+               victimWeights.perAbort * txAborts[slotOf(tid)];
+        break;
+    }
+    if (txAborts[slotOf(tid)] >= starvationLimit) cost += 1e12; // starvation guard
+    return cost;
+}
+
+int LockManager::chooseVictim(const std::vector<int>& candidates) const {
+    int victim = -1;
+    double victimCostSoFar = 0;
+    for (int tid : candidates) {
+        if (!validTransaction(tid)) continue;
+        double cost = victimCost(tid);
+        if (victim == -1 || cost < victimCostSoFar ||
+            (cost == victimCostSoFar && txStart[slotOf(tid)] > txStart[slotOf(victim)])) {
+            victim = tid;
+            victimCostSoFar = cost;
+        }
+    }
+    return victim;
+}
+
+void LockManager::terminate(int tid, Trace& trace) {
+    txActive[slotOf(tid)] = 0;
+    ++txAborts[slotOf(tid)];
+    releaseAll(tid, LockOutcome::Aborted, trace);
+}
+
+void LockManager::releaseAll(int tid, LockOutcome outcome, Trace& trace) {
+    // Items it held or queued for; its locks go straight to waiters
+    int slot = slotOf(tid);
+    std::vector<int> touched(txHeld[slot].begin(), txHeld[slot].end());
+    touched.insert(touched.end(), txWaiting[slot].begin(), txWaiting[slot].end());
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+    txHeld[slot].clear();
+    txWaiting[slot].clear();
+    txChildLocks[slot].clear();
+    txCovered[slot].clear();
+    markTransaction(tid);
+    txDeadlockedSince[slot] = {};
+    for (int did : touched) {
+        std::lock_guard<std::mutex> guard(stripeFor(did).mutex);
+        auto before = itemEdges(did);
+        if (dropHolder(did, tid)) markItem(did);
+        removeRequest(tid, did, outcome);
+        std::vector<int> granted = grantWaiters(did);
+        std::vector<std::vector<int>> cycles = relinkItem(did, before);
+        emitGrants(trace, granted, did);
+        settleCycles(did, cycles, trace);
+        wakeWaiters(did);
+    }
+    grantDeferred(trace);
+}
+
+void LockManager::wakeWaiters(int did) {
+    // Caller holds the item's stripe mutex
+    LockStripe& stripe = stripeFor(did);
+    ++stripe.version;
+    stripe.released.notify_all();
+}
+
+void LockManager::markTransaction(int tid) {
+    int slot = slotOf(tid);
+    if (txChanged[slot]) return;
+    txChanged[slot] = 1;
+    txChangedByLatch[slot % kLockStripes].push_back(slot);
+}
+
+void LockManager::markItem(int did) {
+    if (itemChanged[did]) return;
+    itemChanged[did] = 1;
+    stripeFor(did).changedItems.push_back(did);
+}
+
+void LockManager::takeChanges(ChangeSet& changes) {
+    // Exclusive, so no latch or stripe is needed to drain the lists
+    std::unique_lock<std::shared_mutex> registry(registryMutex);
+    changes.transactionCount = static_cast<int>(txTid.size());
+    changes.dataItemCount = nextDid;
+    changes.transactions.clear();
+    changes.dataItems.clear();
+    for (int i = 0; i < kLockStripes; ++i) {
+        for (int slot : txChangedByLatch[i]) txChanged[slot] = 0;
+        changes.transactions.insert(changes.transactions.end(), txChangedByLatch[i].begin(), txChangedByLatch[i].end());
+        txChangedByLatch[i].clear();
+        for (int did : stripes[i].changedItems) itemChanged[did] = 0;
+        changes.dataItems.insert(changes.dataItems.end(), stripes[i].changedItems.begin(),
+                                 stripes[i].changedItems.end());
+        stripes[i].changedItems.clear();
+    }
+    std::sort(changes.transactions.begin(), changes.transactions.end());
+    std::sort(changes.dataItems.begin(), changes.dataItems.end());
+}
+
+bool LockManager::holdsAtLeast(int tid, int did, LockMode mode) const {
+    return itemHolders[did].contains(tid) && lockModeCovers(heldMode(tid, did), mode);
+}
+
+LockMode LockManager::heldMode(int tid, int did) const {
+    const IdSet& holders = itemHolders[did];
+    return itemHolderModes[did][std::lower_bound(holders.begin(), holders.end(), tid) - holders.begin()];
+}
+
+bool LockManager::compatibleWithOthers(int did, int tid, LockMode mode) const {
+    // Compatible with the group mode means compatible with every holder
+    if (itemHolders[did].empty() || lockModesCompatible(itemMode[did], mode)) return true;
+    const std::vector<LockMode>& modes = itemHolderModes[did];
+    size_t i = 0;
+    for (int h : itemHolders[did]) {
+        if (h != tid && !lockModesCompatible(modes[i], mode)) return false;
+        ++i;
+    }
+    return true;
+}
+
+void LockManager::setHolder(int did, int tid, LockMode mode, bool claimsLinked) {
+    IdSet& holders = itemHolders[did];
+    std::vector<LockMode>& modes = itemHolderModes[did];
+    auto pos = modes.begin() + (std::lower_bound(holders.begin(), holders.end(), tid) - holders.begin());
+    bool added = holders.insert(tid);
+    LockMode old = added ? mode : *pos;
+    if (added) {
+        modes.insert(pos, mode);
+    } else {
+        *pos = mode;
+    }
+    if (!claimsLinked && !itemClaims[did].empty()) {
+        // New edges first: the graph may only ever show more conflicts than there are
+        std::lock_guard<std::mutex> graph(graphMutex);
+        linkClaims(did, tid, mode, true);
+        if (!added) linkClaims(did, tid, old, false);
+    }
+    LockMode group = modes.front();
+    for (LockMode m : modes) group = lockModeSupremum(group, m);
+    itemMode[did] = group;
+}
+
+bool LockManager::dropHolder(int did, int tid) {
+    IdSet& holders = itemHolders[did];
+    std::vector<LockMode>& modes = itemHolderModes[did];
+    auto pos = modes.begin() + (std::lower_bound(holders.begin(), holders.end(), tid) - holders.begin());
+    if (!holders.erase(tid)) return false;
+    if (!itemClaims[did].empty()) {
+        std::lock_guard<std::mutex> graph(graphMutex);
+        linkClaims(did, tid, *pos, false);
+    }
+    modes.erase(pos);
+    if (!modes.empty()) {
+        LockMode group = modes.front();
+        for (LockMode m : modes) group = lockModeSupremum(group, m);
+        itemMode[did] = group;
+    }
+    return true;
+}
+
+void LockManager::linkClaims(int did, int holder, LockMode mode, bool add) {
+    for (const auto& claim : itemClaims[did]) {
+        if (claim.first == holder || lockModesCompatible(mode, claim.second)) continue;
+        if (add) {
+            claimGraph.addEdge(slotOf(claim.first), slotOf(holder));
+        } else {
+            claimGraph.removeEdge(slotOf(claim.first), slotOf(holder));
+        }
+    }
+}
+
+bool LockManager::claimConflicts(int did, int tid, LockMode mode) const {
+    const std::pair<int, LockMode>* claim = findClaim(itemClaims[did], tid);
+    return claim && !lockModesCompatible(mode, claim->second);
+}
+
+int LockManager::claimGrants(int tid, const std::vector<std::pair<int, LockMode>>& grants, int deferring) {
+    std::lock_guard<std::mutex> graph(graphMutex);
+    if (preventionMode == PreventionMode::Avoidance) {
+        std::vector<int> sources;
+        for (const auto& g : grants) {
+            for (const auto& claim : itemClaims[g.first]) {
+                if (claim.first != tid && !lockModesCompatible(g.second, claim.second)) {
+                    sources.push_back(slotOf(claim.first));
                 }
             }
         }
+        std::sort(sources.begin(), sources.end());
+        int reached = claimGraph.reachedSource(slotOf(tid), sources);
+        if (reached != -1) {
+            if (deferring != -1 && deferredItems.insert(deferring)) {
+                deferredItemCount = static_cast<int>(deferredItems.size());
+            }
+            return txTid[reached];
+        }
+    }
+    for (const auto& g : grants) {
+        linkClaims(g.first, tid, g.second, true);
+        if (itemHolders[g.first].contains(tid)) linkClaims(g.first, tid, heldMode(tid, g.first), false);
+    }
+    return -1;
+}
+
+bool LockManager::claimCovers(int tid, int did, LockMode mode) const {
+    for (int item = did; item != -1; item = itemParent[item]) {
+        const std::pair<int, LockMode>* claim = findClaim(itemClaims[item], tid);
+        if (!claim) continue;
+        if (item == did ? lockModeCovers(claim->second, mode) : lockModeCoversDescendants(claim->second, mode)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LockManager::countChild(int tid, int did, int delta) {
+    int parent = itemParent[did];
+    if (parent == -1) return;
+    auto& counts = txChildLocks[slotOf(tid)];
+    auto it = std::lower_bound(counts.begin(), counts.end(), std::make_pair(parent, 0));
+    if (it == counts.end() || it->first != parent) it = counts.insert(it, {parent, 0});
+    it->second += delta;
+    if (it->second == 0) counts.erase(it);
+}
+
+int LockManager::childLocks(int tid, int parent) const {
+    const auto& counts = txChildLocks[slotOf(tid)];
+    auto it = std::lower_bound(counts.begin(), counts.end(), std::make_pair(parent, 0));
+    return it != counts.end() && it->first == parent ? it->second : 0;
+}
+
+IdSet* LockManager::coverageOf(int tid, int did) {
+    for (auto& entry : txCovered[slotOf(tid)]) {
+        if (entry.first == did) return &entry.second;
+    }
+    return nullptr;
+}
+
+IdSet& LockManager::coverageFor(int tid, int did) {
+    if (IdSet* covered = coverageOf(tid, did)) return *covered;
+    txCovered[slotOf(tid)].push_back({did, IdSet()});
+    return txCovered[slotOf(tid)].back().second;
+}
+
+void LockManager::dropCoverage(int tid, int did) {
+    auto& covered = txCovered[slotOf(tid)];
+    covered.erase(std::remove_if(covered.begin(), covered.end(),
+                                 [&](const std::pair<int, IdSet>& entry) {
+                                     return entry.first == did || isBelow(entry.first, did);
+                                 }),
+                  covered.end());
+}
+
+bool LockManager::isBelow(int did, int ancestor) const {
+    for (int p = itemParent[did]; p != -1; p = itemParent[p]) {
+        if (p == ancestor) return true;
+    }
+    return false;
+}
+
+std::vector<int> LockManager::blockersOf(int tid, int did, LockMode mode, bool upgrade) const {
+    std::vector<int> blockers;
+    const IdSet& holders = itemHolders[did];
+    if (!holders.empty() && !lockModesCompatible(itemMode[did], mode)) {
+        size_t i = 0;
+        for (int h : holders) {
+            if (h != tid && !lockModesCompatible(itemHolderModes[did][i], mode)) blockers.push_back(h);
+            ++i;
+        }
     }
+    // An upgrade only queues behind earlier upgrades; anything else goes last
+    for (const LockRequest& r : itemQueue[did]) {
+        if (upgrade && !r.upgrade) break;
+        if (r.tid != tid && !lockModesCompatible(r.mode, mode) &&
+            std::find(blockers.begin(), blockers.end(), r.tid) == blockers.end()) {
+            blockers.push_back(r.tid);
+        }
+    }
+    return blockers;
+}
+
+std::vector<int> LockManager::findCycle() {
+    std::vector<int> cycle = waitForGraph.findCycle();
+    toTids(cycle);
+    return cycle;
+}
 
-    std::set<int> visited;
-    std::vector<int> path, cycle;
-    for (const auto& pair : waitForGraph) {
-        int tid = pair.first;
-        if (visited.find(tid) == visited.end()) {
-            if (dfsCycle(tid, waitForGraph, visited, path, cycle)) {
-                return cycle;
+std::vector<std::pair<int, int>> LockManager::itemEdges(int did) const {
+    // A queued request waits for incompatible holders and incompatible
+    // requests ahead of it. Behind an exclusive request every earlier waiter
+    // and holder is already reachable through it, so later requests only
+    // link back to the nearest one; this keeps hot queues linear in size.
+    std::vector<std::pair<int, int>> edges;
+    const auto& queue = itemQueue[did];
+    const IdSet& holders = itemHolders[did];
+    int barrier = -1;
+    for (int i = 0; i < static_cast<int>(queue.size()); ++i) {
+        const LockRequest& r = queue[i];
+        if (r.unsafeWith != -1) {
+            // Deferred: it waits for the claimant, and nothing waits behind it
+            edges.push_back({r.tid, r.unsafeWith});
+            continue;
+        }
+        if (barrier == -1) {
+            if (!holders.empty() && !lockModesCompatible(itemMode[did], r.mode)) {
+                size_t k = 0;
+                for (int h : holders) {
+                    if (h != r.tid && !lockModesCompatible(itemHolderModes[did][k], r.mode)) {
+                        edges.push_back({r.tid, h});
+                    }
+                    ++k;
+                }
             }
+        } else if (queue[barrier].tid != r.tid) {
+            edges.push_back({r.tid, queue[barrier].tid});
         }
+        for (int j = barrier + 1; j < i; ++j) {
+            if (queue[j].unsafeWith == -1 && queue[j].tid != r.tid && !lockModesCompatible(queue[j].mode, r.mode)) {
+                edges.push_back({r.tid, queue[j].tid});
+            }
+        }
+        if (r.mode == LockMode::Exclusive) barrier = i;
     }
-    return {};
+    std::sort(edges.begin(), edges.end());
+    return edges;
 }
 
-bool LockManager::dfsCycle(int tid, const std::map<int, std::set<int>>& waitForGraph,
-                           std::set<int>& visited, std::vector<int>& path, std::vector<int>& cycle) {
-    visited.insert(tid);
-    path.push_back(tid);
-    auto it = waitForGraph.find(tid);
-    if (it != waitForGraph.end()) {
-        for (int neighbor : it->second) {
-            if (std::find(path.begin(), path.end(), neighbor) != path.end()) {
-                auto start = std::find(path.begin(), path.end(), neighbor);
-                cycle.assign(start, path.end());
-                cycle.push_back(neighbor);
-                return true;
+std::vector<std::vector<int>> LockManager::relinkItem(int did, const std::vector<std::pair<int, int>>& before) {
+    std::vector<std::pair<int, int>> after = itemEdges(did);
+    std::vector<std::pair<int, int>> added;
+    std::vector<std::vector<int>> cycles;
+    std::lock_guard<std::mutex> graph(graphMutex);
+    // Add before removing so edges kept across the change never drop out of
+    // the graph while the new ones are checked.
+    for (const auto& e : after) {
+        if (waitForGraph.addEdge(slotOf(e.first), slotOf(e.second)) &&
+            !std::binary_search(before.begin(), before.end(), e)) {
+            added.push_back(e);
+        }
+    }
+    for (const auto& e : before) waitForGraph.removeEdge(slotOf(e.first), slotOf(e.second));
+    if (added.empty()) return cycles;
+    // Only edges this change introduced can close a new cycle
+    std::int64_t began = nowNs();
+    for (const auto& e : added) {
+        if (!waitForGraph.hasEdge(slotOf(e.first), slotOf(e.second))) continue;
+        std::vector<int> cycle = waitForGraph.findCycleThrough(slotOf(e.first), slotOf(e.second));
+        toTids(cycle);
+        if (!cycle.empty()) cycles.push_back(cycle);
+    }
+    lockMetrics.recordCycleCheck(static_cast<std::uint64_t>(nowNs() - began));
+    return cycles;
+}
+
+std::vector<int> LockManager::grantWaiters(int did, int requester) {
+    std::vector<int> granted;
+    auto& queue = itemQueue[did];
+    IdSet& holders = itemHolders[did];
+    bool claims = !itemClaims[did].empty();
+    bool deferred = false;
+    for (size_t i = 0; i < queue.size();) {
+        const LockRequest r = queue[i];
+        bool grantable = r.upgrade ? compatibleWithOthers(did, r.tid, r.mode)
+                                   : holders.empty() || lockModesCompatible(itemMode[did], r.mode);
+        if (!grantable) {
+            // From here on everyone waits in turn, deferred or not
+            for (size_t j = i; j < queue.size(); ++j) queue[j].unsafeWith = -1;
+            break;
+        }
+        int reached = claims ? claimGrants(r.tid, {{did, r.mode}}, did) : -1;
+        if (reached != -1) {
+            // Granting it could deadlock where the claims say it must not, so
+            // it waits for claims or holdings to change; holding up the
+            // requests behind it could keep the claimant from finishing
+            if (r.unsafeWith == -1) {
+                lockMetrics.add(Counter::UnsafeDeferrals);
+                if (r.tid != requester) {
+                    Trace trace;
+                    Event deferral(EventType::UnsafeDeferred, r.tid, did);
+                    deferral.mode = r.mode;
+                    deferral.value = reached;
+                    emit(trace, deferral);
+                }
             }
-            if (visited.find(neighbor) == visited.end()) {
-                if (dfsCycle(neighbor, waitForGraph, visited, path, cycle)) {
-                    return true;
+            queue[i].unsafeWith = reached;
+            deferred = true;
+            ++i;
+            continue;
+        }
+        setHolder(did, r.tid, r.mode, claims);
+        markItem(did);
+        queue.erase(queue.begin() + i);
+        --queuedRequests;
+        {
+            std::lock_guard<std::mutex> latch(latchFor(r.tid));
+            txWaiting[slotOf(r.tid)].erase(did);
+            if (txWaiting[slotOf(r.tid)].empty()) txDeadlockedSince[slotOf(r.tid)] = {};
+            if (txHeld[slotOf(r.tid)].insert(did)) countChild(r.tid, did, 1);
+            markTransaction(r.tid);
+            ++txWork[slotOf(r.tid)];
+        }
+        if (r.waitingSince != 0) {
+            lockMetrics.add(Counter::GrantedAfterWait);
+            lockMetrics.recordWait(static_cast<std::uint64_t>(nowNs() - r.waitingSince));
+        }
+        if (r.async) {
+            ++r.async->next;
+            postStep(r.async);
+        }
+        granted.push_back(r.tid);
+        // Deferred requests ahead of it may conflict with the new holder
+        i = 0;
+        deferred = false;
+    }
+    if (!deferred && deferredItemCount > 0) {
+        std::lock_guard<std::mutex> graph(graphMutex);
+        if (deferredItems.erase(did)) deferredItemCount = static_cast<int>(deferredItems.size());
+    }
+    return granted;
+}
+
+void LockManager::grantDeferred(Trace& trace) {
+    if (deferredItemCount == 0) return;
+    std::vector<int> items;
+    {
+        std::lock_guard<std::mutex> graph(graphMutex);
+        items.assign(deferredItems.begin(), deferredItems.end());
+    }
+    for (int did : items) {
+        std::lock_guard<std::mutex> guard(stripeFor(did).mutex);
+        auto before = itemEdges(did);
+        std::vector<int> granted = grantWaiters(did);
+        std::vector<std::vector<int>> cycles = relinkItem(did, before);
+        emitGrants(trace, granted, did);
+        settleCycles(did, cycles, trace);
+        if (!granted.empty()) wakeWaiters(did);
+    }
+}
+
+void LockManager::removeRequest(int tid, int did, LockOutcome outcome) {
+    auto& queue = itemQueue[did];
+    for (const LockRequest& r : queue) {
+        if (r.tid == tid && r.async) postCompletion(r.async, outcome);
+    }
+    auto end = std::remove_if(queue.begin(), queue.end(), [tid](const LockRequest& r) { return r.tid == tid; });
+    queuedRequests -= static_cast<long>(queue.end() - end);
+    queue.erase(end, queue.end());
+}
+
+void LockManager::settleCycles(int did, std::vector<std::vector<int>> cycles, Trace& trace) {
+    bool withdraw = blocking && onlineResolution;
+    while (!cycles.empty()) {
+        std::vector<int> cycle = cycles.back();
+        cycles.pop_back();
+        if (withdraw && !cycleIntact(cycle)) continue; // broken by an earlier withdrawal
+        emit(trace, Event(EventType::DeadlockFormed).withIds(cycle));
+        lockMetrics.add(Counter::DeadlocksFormed);
+        lockMetrics.recordCycle(cycle.size() - 1);
+        if (!withdraw) {
+            // Left for detection; remember when so its latency can be measured
+            auto now = std::chrono::steady_clock::now();
+            for (size_t i = 0; i + 1 < cycle.size(); ++i) {
+                std::lock_guard<std::mutex> latch(latchFor(cycle[i]));
+                if (txDeadlockedSince[slotOf(cycle[i])] == std::chrono::steady_clock::time_point()) {
+                    txDeadlockedSince[slotOf(cycle[i])] = now;
                 }
             }
+            continue;
         }
+        // Parked threads cannot run detection themselves: withdraw the request
+        // whose wait closed the cycle and let its owner see the denial.
+        int waiter = cycle.front();
+        {
+            std::lock_guard<std::mutex> latch(latchFor(waiter));
+            if (!txWaiting[slotOf(waiter)].erase(did)) continue;
+            markTransaction(waiter);
+        }
+        auto before = itemEdges(did);
+        removeRequest(waiter, did);
+        std::vector<int> granted = grantWaiters(did);
+        std::vector<std::vector<int>> more = relinkItem(did, before);
+        cycles.insert(cycles.end(), more.begin(), more.end());
+        emitGrants(trace, granted, did);
+        wakeWaiters(did);
     }
-    path.pop_back();
-    return false;
+}
+
+bool LockManager::cycleIntact(const std::vector<int>& cycle) {
+    std::lock_guard<std::mutex> graph(graphMutex);
+    for (size_t i = 0; i + 1 < cycle.size(); ++i) {
+        if (!waitForGraph.hasEdge(slotOf(cycle[i]), slotOf(cycle[i + 1]))) return false;
+    }
+    return true;
 }
@@ -0,0 +1,88 @@
+#include "locktablemodels.h"
+#include <algorithm>
+
+static QString formatIds(const char *prefix, const IdSet &ids) {
+    QString text;
+    for (int id : ids) text += prefix + QString::number(id) + " ";
+    return text;
+}
+
+LockTableModel::LockTableModel(const LockManager &lockManager, const QStringList &headers, QObject *parent)
+    : QAbstractTableModel(parent), lockManager(lockManager), headers(headers), rows(0) {}
+
+int LockTableModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : rows;
+}
+
+int LockTableModel::columnCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : static_cast<int>(headers.size());
+}
+
+QVariant LockTableModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (role != Qt::DisplayRole) return QVariant();
+    if (orientation == Qt::Vertical) return section + 1;
+    return section >= 0 && section < headers.size() ? headers[section] : QVariant();
+}
+
+void LockTableModel::applyChanges(int count, const std::vector<int> &changed) {
+    int oldRows = rows;
+    if (count > rows) {
+        beginInsertRows(QModelIndex(), rows, count - 1);
+        rows = count;
+        endInsertRows();
+    }
+    // One signal per run of consecutive IDs; new rows were just inserted
+    int lastColumn = static_cast<int>(headers.size()) - 1;
+    for (size_t i = 0; i < changed.size();) {
+        size_t j = i;
+        while (j + 1 < changed.size() && changed[j + 1] == changed[j] + 1) ++j;
+        int first = changed[i];
+        int last = std::min(changed[j], oldRows - 1);
+        if (first <= last) emit dataChanged(index(first, 0), index(last, lastColumn), {Qt::DisplayRole});
+        i = j + 1;
+    }
+}
+
+TransactionTableModel::TransactionTableModel(const LockManager &lockManager, QObject *parent)
+    : LockTableModel(lockManager, {"ID", "Status", "Held Locks", "Waiting For"}, parent) {}
+
+QVariant TransactionTableModel::data(const QModelIndex &index, int role) const {
+    if (role != Qt::DisplayRole || !index.isValid() || index.row() >= rows) return QVariant();
+    // One row per slot; a free one waits for the next transaction
+    int tid = lockManager.transactionAt(index.row());
+    if (tid == -1) return index.column() == 1 ? QVariant("Free") : QVariant();
+    switch (index.column()) {
+    case 0:
+        return tid;
+    case 1:
+        return lockManager.isActive(tid) ? "Active" : "Terminated";
+    case 2:
+        return formatIds("D", lockManager.heldLocks(tid));
+    case 3:
+        return formatIds("D", lockManager.waitingFor(tid));
+    }
+    return QVariant();
+}
+
+DataItemTableModel::DataItemTableModel(const LockManager &lockManager, QObject *parent)
+    : LockTableModel(lockManager, {"ID", "Parent", "Lock Holder"}, parent) {}
+
+QVariant DataItemTableModel::data(const QModelIndex &index, int role) const {
+    if (role != Qt::DisplayRole || !index.isValid() || index.row() >= rows) return QVariant();
+    int did = index.row();
+    if (index.column() == 0) return did;
+    if (index.column() == 1) {
+        int parentDid = lockManager.parentOf(did);
+        return parentDid == -1 ? QString("-") : "D" + QString::number(parentDid);
+    }
+    const IdSet &holders = lockManager.lockHolders(did);
+    if (holders.empty()) return "-";
+    // One mode for the whole group unless the holders differ, e.g. IS and IX
+    LockMode group = lockManager.lockMode(did);
+    bool mixed = false;
+    for (int tid : holders) mixed = mixed || lockManager.heldMode(tid, did) != group;
+    if (!mixed) return formatIds("T", holders) + "(" + lockModeName(group) + ")";
+    QString text;
+    for (int tid : holders) text += "T" + QString::number(tid) + "(" + lockModeName(lockManager.heldMode(tid, did)) + ") ";
+    return text;
+}
@@ -0,0 +1,46 @@
+#ifndef LOCKTABLEMODELS_H
+#define LOCKTABLEMODELS_H
+
+#include <QAbstractTableModel>
+#include <QStringList>
+#include <vector>
+#include "LockManager.h"
+
+// Table models over a LockManager. Cell text is formatted on demand from the
+// manager's accessors, so only visible rows cost anything; applyChanges()
+// turns the rows of a LockManager::ChangeSet into row inserts and
+// dataChanged signals.
+class LockTableModel : public QAbstractTableModel {
+    Q_OBJECT
+
+protected:
+    const LockManager &lockManager;
+    QStringList headers;
+    int rows;
+
+public:
+    LockTableModel(const LockManager &lockManager, const QStringList &headers, QObject *parent = nullptr);
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    // Appends rows up to `count` and refreshes the sorted `changed` rows.
+    void applyChanges(int count, const std::vector<int> &changed);
+};
+
+class TransactionTableModel : public LockTableModel {
+    Q_OBJECT
+
+public:
+    explicit TransactionTableModel(const LockManager &lockManager, QObject *parent = nullptr);
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+};
+
+class DataItemTableModel : public LockTableModel {
+    Q_OBJECT
+
+public:
+    explicit DataItemTableModel(const LockManager &lockManager, QObject *parent = nullptr);
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+};
+
+#endif // LOCKTABLEMODELS_H
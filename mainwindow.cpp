@@ -1,4 +1,4 @@
-#include "MainWindow.h"
+#include "mainwindow.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QLabel>
@@ -7,39 +7,118 @@
 #include <QGraphicsPathItem>
 #include <QHeaderView>
 #include <QVector2D>
+#include <QPainterPath>
+#include <QThreadPool>
+#include <QFileDialog>
+#include <QRegularExpression>
 #include <cmath>
 
-MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
+// Lock mode combo entries, in order
+static const LockMode kModes[] = {LockMode::Exclusive, LockMode::Shared, LockMode::IntentionShared,
+                                  LockMode::IntentionExclusive, LockMode::SharedIntentionExclusive};
+
+MainWindow::MainWindow(QWidget *parent)
+    : QMainWindow(parent), detector(lockManager), idleSummary(nullptr), layoutRunning(false), layoutPending(false),
+      reportedDrops(0) {
     // Create widgets
-    transactionTable = new QTableWidget(0, 4);
-    transactionTable->setHorizontalHeaderLabels({"ID", "Status", "Held Locks", "Waiting For"});
+    transactionModel = new TransactionTableModel(lockManager, this);
+    transactionTable = new QTableView;
+    transactionTable->setModel(transactionModel);
     transactionTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
-    dataItemTable = new QTableWidget(0, 2);
-    dataItemTable->setHorizontalHeaderLabels({"ID", "Lock Holder"});
+    transactionTable->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed); // no per-row measuring
+    dataItemModel = new DataItemTableModel(lockManager, this);
+    dataItemTable = new QTableView;
+    dataItemTable->setModel(dataItemModel);
     dataItemTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    dataItemTable->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
     graphScene = new QGraphicsScene;
     graphView = new QGraphicsView(graphScene);
     graphView->setRenderHint(QPainter::Antialiasing);
     graphView->setDragMode(QGraphicsView::ScrollHandDrag);
     graphView->setInteractive(true);
+    deadlockedOnlyCheckBox = new QCheckBox("Deadlocked Components Only");
+    deadlockedOnlyCheckBox->setToolTip("Draw only transactions that are part of a deadlock cycle");
     logText = new QTextEdit;
     logText->setReadOnly(true);
+    logLevelCombo = new QComboBox;
+    logLevelCombo->addItem("All Events");
+    logLevelCombo->addItem("Info and Above");
+    logLevelCombo->addItem("Warnings and Errors");
+    logLevelCombo->addItem("Errors Only");
+    logLevelCombo->setToolTip("Lowest event level shown in the log; grants, acquires and releases are debug events");
+    lockManager.events().setLevel(EventLevel::Debug);
+    eventTimer = new QTimer(this);
+    eventTimer->start(100);
+    statsText = new QTextEdit;
+    statsText->setReadOnly(true);
+    statsText->setMaximumHeight(110);
+    exportMetricsBtn = new QPushButton("Export Metrics");
+    exportMetricsBtn->setToolTip("Save counters, wait histograms and the hottest data items as JSON or Prometheus text");
+    statsTimer = new QTimer(this);
+    statsTimer->start(1000);
     tidInput = new QLineEdit;
     didInput = new QLineEdit;
     addTransactionBtn = new QPushButton("Add Transaction");
-    addTransactionBtn->setToolTip("Add a new transaction");
+    addTransactionBtn->setToolTip("Add a new transaction; DIDs entered declare the items it may lock, in the selected mode");
     addDataItemBtn = new QPushButton("Add Data Item");
     addDataItemBtn->setToolTip("Add a new data item");
+    addChildItemBtn = new QPushButton("Add Child Item");
+    addChildItemBtn->setToolTip("Add a new data item below DID, e.g. a row in a table");
     requestLockBtn = new QPushButton("Request Lock");
-    requestLockBtn->setToolTip("Request a lock for the specified TID on DID");
+    requestLockBtn->setToolTip("Request a lock for the specified TID on DID; several DIDs (e.g. 1,2,3) are locked all or nothing");
     releaseLockBtn = new QPushButton("Release Lock");
     releaseLockBtn->setToolTip("Release the lock held by TID on DID");
     detectDeadlockBtn = new QPushButton("Detect Deadlock");
     detectDeadlockBtn->setToolTip("Check for deadlocks in the current state");
     recoverBtn = new QPushButton("Recover");
     recoverBtn->setToolTip("Recover from the detected deadlock by terminating a transaction");
+    resolveAllBtn = new QPushButton("Resolve All");
+    resolveAllBtn->setToolTip("Find every deadlocked group and terminate a small set of transactions that breaks them all");
+    lockModeCombo = new QComboBox;
+    lockModeCombo->addItem("Exclusive (X)");
+    lockModeCombo->addItem("Shared (S)");
+    lockModeCombo->addItem("Intention Shared (IS)");
+    lockModeCombo->addItem("Intention Exclusive (IX)");
+    lockModeCombo->addItem("Shared + Intention Exclusive (SIX)");
+    lockModeCombo->setToolTip("Lock mode used by Request Lock; a stronger mode than the one held upgrades the lock, "
+                              "and items below others take intention locks on their ancestors first");
+    escalationCombo = new QComboBox;
+    escalationCombo->addItem("No Escalation");
+    escalationCombo->addItem("Escalate at 3");
+    escalationCombo->addItem("Escalate at 10");
+    escalationCombo->addItem("Escalate at 100");
+    escalationCombo->setToolTip("Replace a transaction's locks below one parent by a single lock on the parent "
+                                "once it holds this many");
+    restartBtn = new QPushButton("Restart");
+    restartBtn->setToolTip("Restart the terminated transaction TID; it keeps its age and abort count");
+    commitBtn = new QPushButton("Commit");
+    commitBtn->setToolTip("Commit transaction TID: release all its locks and end it; a later transaction reuses its row");
+    abortBtn = new QPushButton("Abort");
+    abortBtn->setToolTip("Abort transaction TID, active or terminated: release all its locks and end it");
+    victimPolicyCombo = new QComboBox;
+    victimPolicyCombo->addItem("Youngest");
+    victimPolicyCombo->addItem("Fewest Locks");
+    victimPolicyCombo->addItem("Least Work");
+    victimPolicyCombo->addItem("Weighted Cost");
+    victimPolicyCombo->setToolTip("How Recover chooses the transaction to terminate");
     preventionCheckBox = new QCheckBox("Enable Prevention");
-    preventionCheckBox->setToolTip("Enable deadlock prevention by enforcing lock ordering");
+    preventionCheckBox->setToolTip("Enable deadlock prevention using the selected scheme");
+    preventionModeCombo = new QComboBox;
+    preventionModeCombo->addItem("Lock Ordering");
+    preventionModeCombo->addItem("Wait-Die");
+    preventionModeCombo->addItem("Wound-Wait");
+    preventionModeCombo->addItem("Avoidance");
+    preventionModeCombo->setToolTip("Lock Ordering denies out-of-order requests; Wait-Die and Wound-Wait abort by transaction age; "
+                                    "Avoidance refuses grants that could deadlock with declared claims");
+    autoDetectCheckBox = new QCheckBox("Auto Detect");
+    autoDetectCheckBox->setToolTip("Detect and resolve deadlocks periodically without clicking Detect Deadlock");
+    detectIntervalCombo = new QComboBox;
+    detectIntervalCombo->addItem("Every 1 s");
+    detectIntervalCombo->addItem("Adaptive");
+    detectIntervalCombo->setToolTip("Adaptive detects more often while requests are blocked and backs off when idle");
+    detectTimer = new QTimer(this);
+    detectTimer->setSingleShot(true);
+    detector.setFixedInterval(std::chrono::milliseconds(1000));
     QPushButton *fullScreenGraphBtn = new QPushButton("View Graph Full Screen");
     fullScreenGraphBtn->setToolTip("Open the Wait-For Graph in full screen");
 
@@ -55,9 +134,22 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     mainLayout->addWidget(dataItemTable);
     mainLayout->addWidget(new QLabel("Wait-For Graph"));
     mainLayout->addWidget(graphView);
-    mainLayout->addWidget(fullScreenGraphBtn);
-    mainLayout->addWidget(new QLabel("Log"));
+    QHBoxLayout *graphControls = new QHBoxLayout;
+    graphControls->addWidget(fullScreenGraphBtn);
+    graphControls->addWidget(deadlockedOnlyCheckBox);
+    mainLayout->addLayout(graphControls);
+    QHBoxLayout *logControls = new QHBoxLayout;
+    logControls->addWidget(new QLabel("Log"));
+    logControls->addStretch();
+    logControls->addWidget(logLevelCombo);
+    mainLayout->addLayout(logControls);
     mainLayout->addWidget(logText);
+    QHBoxLayout *statsControls = new QHBoxLayout;
+    statsControls->addWidget(new QLabel("Statistics"));
+    statsControls->addStretch();
+    statsControls->addWidget(exportMetricsBtn);
+    mainLayout->addLayout(statsControls);
+    mainLayout->addWidget(statsText);
 
     // Add user guide labels
     QLabel *guideLabel1 = new QLabel("To add transaction, click on Add Transaction button");
@@ -77,13 +169,26 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     inputLayout->addWidget(tidInput);
     inputLayout->addWidget(new QLabel("DID:"));
     inputLayout->addWidget(didInput);
+    inputLayout->addWidget(new QLabel("Mode:"));
+    inputLayout->addWidget(lockModeCombo);
     inputLayout->addWidget(addTransactionBtn);
     inputLayout->addWidget(addDataItemBtn);
+    inputLayout->addWidget(addChildItemBtn);
     inputLayout->addWidget(requestLockBtn);
     inputLayout->addWidget(releaseLockBtn);
     inputLayout->addWidget(detectDeadlockBtn);
     inputLayout->addWidget(recoverBtn);
+    inputLayout->addWidget(resolveAllBtn);
+    inputLayout->addWidget(restartBtn);
+    inputLayout->addWidget(commitBtn);
+    inputLayout->addWidget(abortBtn);
+    inputLayout->addWidget(new QLabel("Victim:"));
+    inputLayout->addWidget(victimPolicyCombo);
+    inputLayout->addWidget(escalationCombo);
     inputLayout->addWidget(preventionCheckBox);
+    inputLayout->addWidget(preventionModeCombo);
+    inputLayout->addWidget(autoDetectCheckBox);
+    inputLayout->addWidget(detectIntervalCombo);
     mainLayout->addLayout(inputLayout);
 
     setCentralWidget(centralWidget);
@@ -92,41 +197,97 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     // Connect signals
     connect(addTransactionBtn, &QPushButton::clicked, this, &MainWindow::addTransaction);
     connect(addDataItemBtn, &QPushButton::clicked, this, &MainWindow::addDataItem);
+    connect(addChildItemBtn, &QPushButton::clicked, this, &MainWindow::addChildItem);
     connect(requestLockBtn, &QPushButton::clicked, this, &MainWindow::requestLock);
     connect(releaseLockBtn, &QPushButton::clicked, this, &MainWindow::releaseLock);
     connect(detectDeadlockBtn, &QPushButton::clicked, this, &MainWindow::detectDeadlock);
     connect(recoverBtn, &QPushButton::clicked, this, &MainWindow::recover);
+    connect(resolveAllBtn, &QPushButton::clicked, this, &MainWindow::resolveAllDeadlocks);
+    connect(restartBtn, &QPushButton::clicked, this, &MainWindow::restartTransaction);
+    connect(commitBtn, &QPushButton::clicked, this, &MainWindow::commitTransaction);
+    connect(abortBtn, &QPushButton::clicked, this, &MainWindow::abortTransaction);
+    connect(victimPolicyCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::changeVictimPolicy);
+    connect(escalationCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::changeEscalation);
     connect(preventionCheckBox, &QCheckBox::toggled, this, &MainWindow::togglePrevention);
+    connect(preventionModeCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::changePreventionMode);
+    connect(autoDetectCheckBox, &QCheckBox::toggled, this, &MainWindow::toggleAutoDetect);
+    connect(detectIntervalCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::changeDetectInterval);
+    connect(detectTimer, &QTimer::timeout, this, &MainWindow::runDetector);
+    connect(eventTimer, &QTimer::timeout, this, &MainWindow::drainEvents);
+    connect(statsTimer, &QTimer::timeout, this, &MainWindow::refreshStats);
+    connect(exportMetricsBtn, &QPushButton::clicked, this, &MainWindow::exportMetrics);
+    connect(logLevelCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::changeLogLevel);
     connect(fullScreenGraphBtn, &QPushButton::clicked, this, &MainWindow::onFullScreenGraph);
+    connect(deadlockedOnlyCheckBox, &QCheckBox::toggled, this, [this] { refreshGraph(); });
 }
 
-MainWindow::~MainWindow() {}
+MainWindow::~MainWindow() {
+    // A layout job still running holds `this`; its queued result is dropped with the window
+    QThreadPool::globalInstance()->waitForDone();
+}
 
 void MainWindow::addTransaction() {
-    int tid = lockManager.addTransaction();
-    logText->append("Added transaction T" + QString::number(tid));
+    // Any DIDs entered are the new transaction's claims
+    std::vector<int> claims;
+    QString claimed;
+    for (const QString &part : didInput->text().split(QRegularExpression("[,\\s]+"), Qt::SkipEmptyParts)) {
+        bool ok;
+        claims.push_back(part.toInt(&ok));
+        if (!ok) {
+            appendLog("Invalid DID");
+            return;
+        }
+        claimed += " D" + QString::number(claims.back());
+    }
+    int tid = lockManager.addTransaction(claims, kModes[lockModeCombo->currentIndex()]);
+    if (tid == -1) {
+        appendLog("Claims must name existing data items");
+        return;
+    }
+    appendLog("Added transaction T" + QString::number(tid) + (claims.empty() ? QString() : " claiming" + claimed));
     refreshTables();
     refreshGraph();
 }
 
 void MainWindow::addDataItem() {
     int did = lockManager.addDataItem();
-    logText->append("Added data item D" + QString::number(did));
+    appendLog("Added data item D" + QString::number(did));
+    refreshTables();
+    refreshGraph();
+}
+
+void MainWindow::addChildItem() {
+    bool didOk;
+    int parent = didInput->text().toInt(&didOk);
+    int did = didOk ? lockManager.addDataItem(parent) : -1;
+    if (did == -1) {
+        appendLog("Enter the DID of an existing parent item");
+        return;
+    }
+    appendLog("Added data item D" + QString::number(did) + " below D" + QString::number(parent));
     refreshTables();
     refreshGraph();
 }
 
 void MainWindow::requestLock() {
-    bool tidOk, didOk;
+    bool tidOk, didOk = true;
     int tid = tidInput->text().toInt(&tidOk);
-    int did = didInput->text().toInt(&didOk);
-    if (!tidOk || !didOk) {
-        logText->append("Invalid TID or DID");
+    std::vector<int> dids;
+    for (const QString &part : didInput->text().split(QRegularExpression("[,\\s]+"), Qt::SkipEmptyParts)) {
+        bool ok;
+        dids.push_back(part.toInt(&ok));
+        didOk = didOk && ok;
+    }
+    if (!tidOk || !didOk || dids.empty()) {
+        appendLog("Invalid TID or DID");
         return;
     }
-    std::string log;
-    lockManager.requestLock(tid, did, log);
-    logText->append(QString::fromStdString(log));
+    LockMode mode = kModes[lockModeCombo->currentIndex()];
+    if (dids.size() == 1) {
+        lockManager.requestLock(tid, dids[0], mode);
+    } else {
+        lockManager.requestLocks(tid, dids, mode);
+    }
     refreshTables();
     refreshGraph();
 }
@@ -136,33 +297,200 @@ void MainWindow::releaseLock() {
     int tid = tidInput->text().toInt(&tidOk);
     int did = didInput->text().toInt(&didOk);
     if (!tidOk || !didOk) {
-        logText->append("Invalid TID or DID");
+        appendLog("Invalid TID or DID");
         return;
     }
-    std::string log;
-    lockManager.releaseLock(tid, did, log);
-    logText->append(QString::fromStdString(log));
+    lockManager.releaseLock(tid, did);
     refreshTables();
     refreshGraph();
 }
 
 void MainWindow::detectDeadlock() {
-    std::string log;
-    lockManager.detectDeadlock(log, currentCycle);
-    logText->append(QString::fromStdString(log));
+    lockManager.detectDeadlock(currentCycle);
 }
 
 void MainWindow::recover() {
-    std::string log;
-    lockManager.recover(currentCycle, log);
-    logText->append(QString::fromStdString(log));
+    lockManager.recover(currentCycle);
+    refreshTables();
+    refreshGraph();
+}
+
+void MainWindow::resolveAllDeadlocks() {
+    std::vector<std::vector<int>> components;
+    std::vector<int> victims;
+    bool found = lockManager.detectAllDeadlocks(components);
+    if (!found) return;
+    lockManager.recoverAll(components, victims);
+    currentCycle.clear();
     refreshTables();
     refreshGraph();
 }
 
+void MainWindow::restartTransaction() {
+    bool tidOk;
+    int tid = tidInput->text().toInt(&tidOk);
+    if (!tidOk) {
+        appendLog("Invalid TID");
+        return;
+    }
+    lockManager.restartTransaction(tid);
+    refreshTables();
+    refreshGraph();
+}
+
+void MainWindow::commitTransaction() {
+    bool tidOk;
+    int tid = tidInput->text().toInt(&tidOk);
+    if (!tidOk) {
+        appendLog("Invalid TID");
+        return;
+    }
+    lockManager.commitTransaction(tid);
+    refreshTables();
+    refreshGraph();
+}
+
+void MainWindow::abortTransaction() {
+    bool tidOk;
+    int tid = tidInput->text().toInt(&tidOk);
+    if (!tidOk) {
+        appendLog("Invalid TID");
+        return;
+    }
+    lockManager.abortTransaction(tid);
+    refreshTables();
+    refreshGraph();
+}
+
+void MainWindow::changeVictimPolicy(int index) {
+    lockManager.setVictimPolicy(static_cast<VictimPolicy>(index));
+    appendLog("Victim policy: " + victimPolicyCombo->itemText(index));
+}
+
+void MainWindow::changeEscalation(int index) {
+    static const int kThresholds[] = {0, 3, 10, 100};
+    lockManager.setEscalationThreshold(kThresholds[index]);
+    appendLog("Lock escalation: " + escalationCombo->itemText(index));
+}
+
 void MainWindow::togglePrevention(bool checked) {
-    lockManager.setPreventionEnabled(checked);
-    logText->append("Prevention " + QString(checked ? "enabled" : "disabled"));
+    // Combo entries follow PreventionMode, shifted past None
+    lockManager.setPreventionMode(checked ? static_cast<PreventionMode>(preventionModeCombo->currentIndex() + 1)
+                                          : PreventionMode::None);
+    appendLog("Prevention " + QString(checked ? "enabled (" + preventionModeCombo->currentText() + ")" : "disabled"));
+}
+
+void MainWindow::changePreventionMode(int index) {
+    if (!preventionCheckBox->isChecked()) return;
+    lockManager.setPreventionMode(static_cast<PreventionMode>(index + 1));
+    appendLog("Prevention scheme: " + preventionModeCombo->itemText(index));
+}
+
+void MainWindow::toggleAutoDetect(bool checked) {
+    if (checked) {
+        runDetector();
+    } else {
+        detectTimer->stop();
+    }
+    appendLog("Auto detection " + QString(checked ? "enabled" : "disabled"));
+}
+
+void MainWindow::changeDetectInterval(int index) {
+    if (index == 1) {
+        detector.setAdaptive(std::chrono::milliseconds(100), std::chrono::milliseconds(5000));
+    } else {
+        detector.setFixedInterval(std::chrono::milliseconds(1000));
+    }
+    if (autoDetectCheckBox->isChecked()) runDetector();
+}
+
+void MainWindow::runDetector() {
+    std::string log;
+    std::chrono::milliseconds delay = detector.runOnce(log);
+    if (!log.empty()) {
+        // The detector's messages arrive as events
+        DetectorStats stats = detector.stats();
+        drainEvents();
+        if (stats.latencySamples > 0) {
+            logText->append(QString("Detection latency: mean %1 ms, max %2 ms over %3 deadlock(s)")
+                                .arg(stats.meanLatencyMs, 0, 'f', 1)
+                                .arg(stats.maxLatencyMs, 0, 'f', 1)
+                                .arg(stats.latencySamples));
+        }
+        currentCycle.clear();
+        refreshTables();
+        refreshGraph();
+    }
+    if (autoDetectCheckBox->isChecked()) detectTimer->start(static_cast<int>(delay.count()));
+}
+
+void MainWindow::drainEvents() {
+    // At most one batch per tick, appended as a single block
+    EventLog &events = lockManager.events();
+    eventBatch.clear();
+    events.drain(eventBatch, 4096);
+    QString text = QString::fromStdString(formatEvents(eventBatch));
+    std::uint64_t dropped = events.dropped();
+    if (dropped != reportedDrops) {
+        if (!text.isEmpty()) text += "\n";
+        text += QString("(%1 events dropped)").arg(dropped - reportedDrops);
+        reportedDrops = dropped;
+    }
+    if (!text.isEmpty()) logText->append(text);
+}
+
+void MainWindow::changeLogLevel(int index) {
+    // Combo entries follow EventLevel
+    drainEvents();
+    lockManager.events().setLevel(static_cast<EventLevel>(index));
+}
+
+void MainWindow::refreshStats() {
+    lockManager.snapshotMetrics(metrics, 5);
+    auto ms = [](std::uint64_t ns) { return QString::number(ns / 1e6, 'f', 2); };
+    QString hot;
+    for (const auto &item : metrics.hotItems) hot += QString(" D%1 (%2)").arg(item.first).arg(item.second);
+    statsText->setPlainText(
+        QString("Requests %1, granted at once %2, waited %3 (granted later %4), released %5, escalations %6\n")
+            .arg(metrics[Counter::Requests])
+            .arg(metrics[Counter::Granted])
+            .arg(metrics[Counter::Waited])
+            .arg(metrics[Counter::GrantedAfterWait])
+            .arg(metrics[Counter::Released])
+            .arg(metrics[Counter::Escalations]) +
+        QString("Prevention: ordering denials %1, wait-die aborts %2, wounds %3, unsafe deferrals %4\n")
+            .arg(metrics[Counter::OrderingDenials])
+            .arg(metrics[Counter::WaitDieAborts])
+            .arg(metrics[Counter::Wounds])
+            .arg(metrics[Counter::UnsafeDeferrals]) +
+        QString("Deadlocks formed %1, detected %2, victims %3 over %4 detection pass(es)\n")
+            .arg(metrics[Counter::DeadlocksFormed])
+            .arg(metrics[Counter::DeadlocksDetected])
+            .arg(metrics[Counter::Victims])
+            .arg(metrics[Counter::DetectionPasses]) +
+        QString("Lock wait: p50 %1 ms, p99 %2 ms, max %3 ms; detection: mean %4 ms, max %5 ms\n")
+            .arg(ms(metrics.waitNs.percentile(0.5)))
+            .arg(ms(metrics.waitNs.percentile(0.99)))
+            .arg(ms(metrics.waitNs.max))
+            .arg(ms(static_cast<std::uint64_t>(metrics.detectionNs.mean())))
+            .arg(ms(metrics.detectionNs.max)) +
+        "Hottest items:" + (hot.isEmpty() ? QString(" none") : hot));
+}
+
+void MainWindow::exportMetrics() {
+    QString path = QFileDialog::getSaveFileName(this, "Export Metrics", "metrics.json",
+                                                "JSON (*.json);;Prometheus text (*.prom)");
+    if (path.isEmpty()) return;
+    MetricsSnapshot snapshot;
+    lockManager.snapshotMetrics(snapshot);
+    std::string log;
+    writeMetrics(snapshot, path.toStdString(), log);
+    appendLog(QString::fromStdString(log));
+}
+
+void MainWindow::appendLog(const QString &text) {
+    drainEvents();
+    logText->append(text);
 }
 
 void MainWindow::onFullScreenGraph() {
@@ -179,127 +507,155 @@ void MainWindow::onFullScreenGraph() {
 }
 
 void MainWindow::refreshTables() {
-    const auto& transactions = lockManager.getTransactions();
-    transactionTable->setRowCount(transactions.size());
-    for (size_t i = 0; i < transactions.size(); ++i) {
-        const auto& T = transactions[i];
-        transactionTable->setItem(i, 0, new QTableWidgetItem(QString::number(T.id)));
-        transactionTable->setItem(i, 1, new QTableWidgetItem(T.active ? "Active" : "Terminated"));
-        QString heldLocks;
-        for (int did : T.heldLocks) heldLocks += "D" + QString::number(did) + " ";
-        transactionTable->setItem(i, 2, new QTableWidgetItem(heldLocks));
-        QString waitingFor;
-        for (int did : T.waitingFor) waitingFor += "D" + QString::number(did) + " ";
-        transactionTable->setItem(i, 3, new QTableWidgetItem(waitingFor));
-    }
+    // Only rows the manager reports as changed are repainted
+    lockManager.takeChanges(changes);
+    transactionModel->applyChanges(changes.transactionCount, changes.transactions);
+    dataItemModel->applyChanges(changes.dataItemCount, changes.dataItems);
+}
 
-    const auto& dataItems = lockManager.getDataItems();
-    const auto& lockTable = lockManager.getLockTable();
-    dataItemTable->setRowCount(dataItems.size());
-    for (size_t i = 0; i < dataItems.size(); ++i) {
-        int did = dataItems[i];
-        dataItemTable->setItem(i, 0, new QTableWidgetItem(QString::number(did)));
-        int holder = lockTable.at(did);
-        dataItemTable->setItem(i, 1, new QTableWidgetItem(holder == -1 ? "-" : "T" + QString::number(holder)));
+void MainWindow::refreshGraph() {
+    // Snapshot on the UI thread, lay out on a worker; a refresh that arrives
+    // while a layout is running is folded into one follow-up pass
+    if (layoutRunning) {
+        layoutPending = true;
+        return;
     }
+    GraphSnapshot snapshot;
+    snapshot.deadlockedOnly = deadlockedOnlyCheckBox->isChecked();
+    const WaitForGraph &graph = lockManager.getWaitForGraph();
+    // The graph's nodes are transaction slots; free and terminated ones are skipped
+    int slots = lockManager.transactionCount();
+    for (int slot = 0; slot < slots; ++slot) {
+        int tid = lockManager.transactionAt(slot);
+        if (tid == -1 || !lockManager.isActive(tid)) continue;
+        snapshot.transactions.push_back(tid);
+        for (int to : graph.successors(slot)) snapshot.edges.push_back({tid, lockManager.transactionAt(to)});
+    }
+    layoutRunning = true;
+    QThreadPool::globalInstance()->start([this, snapshot] {
+        GraphLayout layout = GraphLayout::compute(snapshot);
+        QMetaObject::invokeMethod(this, [this, layout] { applyLayout(layout); }, Qt::QueuedConnection);
+    });
 }
 
-void MainWindow::refreshGraph() {
-    graphScene->clear();
-    const auto& transactions = lockManager.getTransactions();
-    const auto& lockTable = lockManager.getLockTable();
-    if (transactions.empty()) return;
-
-    double radius = std::max(100.0, 50.0 * transactions.size());
-    double angleStep = 2 * M_PI / transactions.size();
-    std::map<int, QPointF> positions;
-
-    // Place nodes
-    for (size_t i = 0; i < transactions.size(); ++i) {
-        if (!transactions[i].active) continue;
-        double angle = i * angleStep;
-        double x = radius * cos(angle);
-        double y = radius * sin(angle);
-        positions[transactions[i].id] = QPointF(x, y);
-        auto *node = graphScene->addEllipse(x - 10, y - 10, 20, 20);
-        node->setBrush(Qt::lightGray);
-        auto *text = graphScene->addText("T" + QString::number(transactions[i].id));
-        text->setPos(x - 5, y - 5);
+// Curved edge with an arrowhead. Edges with a reverse partner bow to
+// opposite sides so the pair does not overlap.
+static QPainterPath edgePath(QPointF fromPos, QPointF toPos, bool hasReverse, bool curveAbove) {
+    QPointF vec = toPos - fromPos;
+    QPointF perp(-vec.y(), vec.x());
+    double length = std::sqrt(perp.x()*perp.x() + perp.y()*perp.y());
+    if (length > 0) {
+        perp /= length;
+    }
+    double offset = 20.0;
+    if (hasReverse) {
+        perp *= curveAbove ? offset : -offset;
+    } else {
+        // Single direction, slight curve for clarity
+        perp *= offset * 0.5;
     }
 
-    // Build the wait-for graph and track bidirectional edges
-    std::map<std::pair<int, int>, bool> hasReverseEdge;
-    std::map<int, std::set<int>> waitForGraph;
-    for (const auto& T : transactions) {
-        if (T.active && !T.waitingFor.empty()) {
-            for (int did : T.waitingFor) {
-                auto it = lockTable.find(did);
-                if (it != lockTable.end() && it->second != -1 && it->second != T.id) {
-                    int from = T.id;
-                    int to = it->second;
-                    waitForGraph[from].insert(to);
-                    hasReverseEdge[{from, to}] = waitForGraph[to].count(from) > 0;
-                }
-            }
+    QPointF midpoint = (fromPos + toPos) / 2;
+    QPointF controlPoint = midpoint + perp;
+    QPainterPath path;
+    path.moveTo(fromPos);
+    path.quadTo(controlPoint, toPos);
+
+    QVector2D normalizedVec = QVector2D(vec).normalized();
+    QPointF arrowP1 = toPos - (normalizedVec.toPointF() * 10);
+    QVector2D normalizedPerp = QVector2D(-vec.y(), vec.x()).normalized();
+    QPointF arrowP2 = arrowP1 + (normalizedPerp.toPointF() * 5);
+    QPointF arrowP3 = arrowP1 - (normalizedPerp.toPointF() * 5);
+    path.moveTo(toPos);
+    path.lineTo(arrowP2);
+    path.lineTo(arrowP3);
+    path.lineTo(toPos);
+    return path;
+}
+
+void MainWindow::applyLayout(const GraphLayout &layout) {
+    layoutRunning = false;
+
+    // Nodes: drop the ones that left, add new ones, move or recolour the rest
+    for (auto it = nodeItems.begin(); it != nodeItems.end();) {
+        if (layout.find(it->first) == -1) {
+            delete it->second;
+            nodeComponents.erase(it->first);
+            it = nodeItems.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (const auto &node : layout.nodes) {
+        QGraphicsEllipseItem *&item = nodeItems[node.tid];
+        if (!item) {
+            item = graphScene->addEllipse(-10, -10, 20, 20);
+            item->setZValue(1);
+            auto *text = new QGraphicsSimpleTextItem("T" + QString::number(node.tid), item);
+            text->setPos(-5, -5);
+            nodeComponents[node.tid] = -2; // forces the brush below
+        }
+        QPointF pos(node.x, node.y);
+        if (item->pos() != pos) item->setPos(pos);
+        int &component = nodeComponents[node.tid];
+        if (component != node.component) {
+            component = node.component;
+            item->setBrush(node.component == -1 ? QBrush(Qt::lightGray) : QBrush(QColor(255, 140, 140)));
         }
     }
 
-    // Draw curved edges with arrows
-    for (const auto& pair : waitForGraph) {
-        int from = pair.first;
-        QPointF fromPos = positions[from];
-        for (int to : pair.second) {
-            QPointF toPos = positions[to];
-            QPointF vec = toPos - fromPos;
-            QPointF perp(-vec.y(), vec.x());
-            double length = std::sqrt(perp.x()*perp.x() + perp.y()*perp.y());
-            if (length > 0) {
-                perp /= length;
-            }
-
-            // Determine curve direction: above or below based on bidirectional edge
-            double offset = 20.0;
-            bool hasReverse = hasReverseEdge[{from, to}] || hasReverseEdge[{to, from}];
-            if (hasReverse) {
-                // If there's a reverse edge, curve one above and one below
-                // Use transaction IDs to consistently decide direction
-                if (from < to) {
-                    // Curve above
-                    perp *= offset;
-                } else {
-                    // Curve below
-                    perp *= -offset;
-                }
-            } else {
-                // Single direction, slight curve for clarity
-                perp *= offset * 0.5;
-            }
-
-            QPointF midpoint = (fromPos + toPos) / 2;
-            QPointF controlPoint = midpoint + perp;
-            QPainterPath path;
-            path.moveTo(fromPos);
-            path.quadTo(controlPoint, toPos);
-
-            // Add arrowhead using QVector2D for normalization
-            QVector2D vec2D(vec);
-            QVector2D normalizedVec = vec2D.normalized();
-            QPointF arrowP1 = toPos - (normalizedVec.toPointF() * 10);
-
-            QVector2D perpVec(-vec.y(), vec.x());
-            QVector2D normalizedPerp = perpVec.normalized();
-            QPointF arrowP2 = arrowP1 + (normalizedPerp.toPointF() * 5);
-            QPointF arrowP3 = arrowP1 - (normalizedPerp.toPointF() * 5);
-
-            QPainterPath arrowPath;
-            arrowPath.moveTo(toPos);
-            arrowPath.lineTo(arrowP2);
-            arrowPath.lineTo(arrowP3);
-            arrowPath.lineTo(toPos);
-
-            // Add the path and arrowhead to the scene
-            graphScene->addPath(path, QPen(Qt::blue, 4));
-            graphScene->addPath(arrowPath, QPen(Qt::blue, 4));
+    // Edges: same diff, keyed by (from, to)
+    std::map<std::pair<int, int>, bool> wanted;
+    for (const auto &edge : layout.edges) wanted[edge] = true;
+    for (auto it = edgeItems.begin(); it != edgeItems.end();) {
+        if (!wanted.count(it->first)) {
+            delete it->second.item;
+            it = edgeItems.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (const auto &edge : layout.edges) {
+        const auto &from = layout.nodes[layout.find(edge.first)];
+        const auto &to = layout.nodes[layout.find(edge.second)];
+        QPointF fromPos(from.x, from.y), toPos(to.x, to.y);
+        bool reverse = wanted.count({edge.second, edge.first}) > 0;
+        bool curveAbove = edge.first < edge.second;
+        bool deadlocked = from.component != -1 && from.component == to.component;
+        auto it = edgeItems.find(edge);
+        if (it == edgeItems.end()) {
+            it = edgeItems.insert({edge, EdgeItem{graphScene->addPath(QPainterPath()), QPointF(), QPointF(), false,
+                                                  false, false}}).first;
+            it->second.item->setPen(QPen(Qt::blue, 4));
         }
+        EdgeItem &e = it->second;
+        if (e.item->path().isEmpty() || e.from != fromPos || e.to != toPos || e.reverse != reverse ||
+            e.curveAbove != curveAbove) {
+            e.item->setPath(edgePath(fromPos, toPos, reverse, curveAbove));
+            e.from = fromPos;
+            e.to = toPos;
+            e.reverse = reverse;
+            e.curveAbove = curveAbove;
+        }
+        if (e.deadlocked != deadlocked) {
+            e.deadlocked = deadlocked;
+            e.item->setPen(QPen(deadlocked ? Qt::red : Qt::blue, 4));
+        }
+    }
+
+    // Level of detail: idle transactions beyond a handful become one label
+    if (layout.collapsedIdle > 0) {
+        if (!idleSummary) idleSummary = graphScene->addSimpleText(QString());
+        idleSummary->setText("+" + QString::number(layout.collapsedIdle) + " idle transactions");
+        idleSummary->setPos(layout.summaryX, layout.summaryY);
+    } else if (idleSummary) {
+        delete idleSummary;
+        idleSummary = nullptr;
+    }
+
+    // The state moved on while this layout ran
+    if (layoutPending) {
+        layoutPending = false;
+        refreshGraph();
     }
 }
@@ -2,29 +2,74 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QTableWidget>
+#include <QTableView>
 #include <QGraphicsView>
 #include <QTextEdit>
 #include <QLineEdit>
 #include <QPushButton>
 #include <QCheckBox>
+#include <QComboBox>
 #include <QDialog>
+#include <QTimer>
+#include <QGraphicsEllipseItem>
+#include <QGraphicsPathItem>
+#include <QGraphicsSimpleTextItem>
+#include <map>
+#include <utility>
 #include "LockManager.h"
+#include "GraphLayout.h"
+#include "DeadlockDetector.h"
+#include "locktablemodels.h"
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
 
 private:
     LockManager lockManager;
-    QTableWidget *transactionTable;
-    QTableWidget *dataItemTable;
+    DeadlockDetector detector; // driven from detectTimer so the tables never race it
+    QTimer *detectTimer;
+    QTableView *transactionTable;
+    QTableView *dataItemTable;
+    TransactionTableModel *transactionModel;
+    DataItemTableModel *dataItemModel;
+    LockManager::ChangeSet changes; // reused by refreshTables
     QGraphicsView *graphView;
     QGraphicsScene *graphScene;
+    QCheckBox *deadlockedOnlyCheckBox;
+    // Scene items persist across refreshes and are only touched when their
+    // node or edge changes. Layout runs on a worker thread, one job at a time.
+    struct EdgeItem {
+        QGraphicsPathItem *item;
+        QPointF from, to;
+        bool curveAbove;
+        bool reverse;
+        bool deadlocked;
+    };
+    std::map<int, QGraphicsEllipseItem *> nodeItems;
+    std::map<int, int> nodeComponents; // last drawn component per node, -1 if none
+    std::map<std::pair<int, int>, EdgeItem> edgeItems;
+    QGraphicsSimpleTextItem *idleSummary;
+    bool layoutRunning;
+    bool layoutPending;
     QTextEdit *logText;
+    QTimer *eventTimer;       // drains lockManager.events() into logText
+    QComboBox *logLevelCombo;
+    std::vector<Event> eventBatch; // reused by drainEvents
+    std::uint64_t reportedDrops;
+    QTextEdit *statsText;
+    QPushButton *exportMetricsBtn;
+    QTimer *statsTimer;
+    MetricsSnapshot metrics; // reused by refreshStats
     QLineEdit *tidInput, *didInput;
-    QPushButton *addTransactionBtn, *addDataItemBtn, *requestLockBtn, *releaseLockBtn,
-        *detectDeadlockBtn, *recoverBtn;
+    QPushButton *addTransactionBtn, *addDataItemBtn, *addChildItemBtn, *requestLockBtn, *releaseLockBtn,
+        *detectDeadlockBtn, *recoverBtn, *resolveAllBtn, *restartBtn, *commitBtn, *abortBtn;
     QCheckBox *preventionCheckBox;
+    QComboBox *lockModeCombo;
+    QComboBox *victimPolicyCombo;
+    QComboBox *escalationCombo;
+    QComboBox *preventionModeCombo;
+    QCheckBox *autoDetectCheckBox;
+    QComboBox *detectIntervalCombo;
     std::vector<int> currentCycle;
     // Full-screen graph components
     QDialog *graphDialog;
@@ -37,16 +82,34 @@ public:
 private slots:
     void addTransaction();
     void addDataItem();
+    void addChildItem();
     void requestLock();
     void releaseLock();
     void detectDeadlock();
     void recover();
+    void resolveAllDeadlocks();
+    void restartTransaction();
+    void commitTransaction();
+    void abortTransaction();
+    void changeVictimPolicy(int index);
+    void changeEscalation(int index);
     void togglePrevention(bool checked);
+    void changePreventionMode(int index);
+    void toggleAutoDetect(bool checked);
+    void changeDetectInterval(int index);
+    void runDetector();
+    void drainEvents();
+    void changeLogLevel(int index);
+    void refreshStats();
+    void exportMetrics();
     void onFullScreenGraph(); // Slot for full-screen graph button
 
 private:
+    // Drains pending events first so messages stay in order.
+    void appendLog(const QString &text);
     void refreshTables();
     void refreshGraph();
+    void applyLayout(const GraphLayout &layout);
 };
 
 #endif // MAINWINDOW_H
\ No newline at end of file
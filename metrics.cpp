@@ -0,0 +1,190 @@
+#include "Metrics.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+const char* counterName(Counter counter) {
+    static const char* const kNames[] = {
+        "requests",       "granted",         "waited",          "granted_after_wait",
+        "released",       "ordering_denials", "wait_die_aborts", "wounds",
+        "deadlocks_formed", "deadlocks_detected", "victims",     "detection_passes",
+        "escalations",    "timeouts",        "unsafe_deferrals", "commits",
+        "aborts",
+    };
+    return kNames[static_cast<int>(counter)];
+}
+
+Histogram::Histogram() : count(0), sum(0), max(0) {
+    for (auto& bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+}
+
+int Histogram::bucketOf(std::uint64_t value) {
+    if (value < static_cast<std::uint64_t>(kSubBuckets)) return static_cast<int>(value);
+    int top = 63;
+    while (!(value >> top)) --top;
+    int shift = top - kSubBucketBits;
+    int bucket = (shift + 1) * kSubBuckets + static_cast<int>(value >> shift) - kSubBuckets;
+    return bucket < kBuckets ? bucket : kBuckets - 1;
+}
+
+std::uint64_t Histogram::bucketLimit(int bucket) {
+    if (bucket < kSubBuckets) return static_cast<std::uint64_t>(bucket);
+    int shift = bucket / kSubBuckets - 1;
+    std::uint64_t low = static_cast<std::uint64_t>(bucket % kSubBuckets + kSubBuckets) << shift;
+    return low + (std::uint64_t(1) << shift) - 1;
+}
+
+void Histogram::record(std::uint64_t value) {
+    buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+    std::uint64_t seen = max.load(std::memory_order_relaxed);
+    while (value > seen && !max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+}
+
+void HistogramSnapshot::merge(const Histogram& histogram) {
+    if (buckets.empty()) buckets.assign(Histogram::kBuckets, 0);
+    for (int i = 0; i < Histogram::kBuckets; ++i) buckets[i] += histogram.buckets[i].load(std::memory_order_relaxed);
+    count += histogram.count.load(std::memory_order_relaxed);
+    sum += histogram.sum.load(std::memory_order_relaxed);
+    std::uint64_t m = histogram.max.load(std::memory_order_relaxed);
+    if (m > max) max = m;
+}
+
+std::uint64_t HistogramSnapshot::percentile(double fraction) const {
+    // Buckets and count are read separately, so go by the bucket total
+    std::uint64_t total = 0;
+    for (std::uint64_t n : buckets) total += n;
+    if (total == 0) return 0;
+    std::uint64_t rank = static_cast<std::uint64_t>(fraction * total + 0.5);
+    if (rank < 1) rank = 1;
+    std::uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            std::uint64_t limit = Histogram::bucketLimit(static_cast<int>(i));
+            return limit < max ? limit : max;
+        }
+    }
+    return max;
+}
+
+LockMetrics::Shard::Shard() {
+    for (auto& counter : counters) counter.store(0, std::memory_order_relaxed);
+}
+
+LockMetrics::Shard& LockMetrics::local() {
+    static std::atomic<unsigned> nextShard(0);
+    thread_local unsigned shard = nextShard.fetch_add(1, std::memory_order_relaxed) % kShards;
+    return shards[shard];
+}
+
+void LockMetrics::snapshot(MetricsSnapshot& snapshot) const {
+    snapshot = MetricsSnapshot();
+    for (const Shard& shard : shards) {
+        for (int i = 0; i < static_cast<int>(Counter::kCount); ++i) {
+            snapshot.counters[i] += shard.counters[i].load(std::memory_order_relaxed);
+        }
+        snapshot.waitNs.merge(shard.waitNs);
+        snapshot.detectionNs.merge(shard.detectionNs);
+        snapshot.cycleLength.merge(shard.cycleLength);
+        snapshot.cycleCheckNs.merge(shard.cycleCheckNs);
+    }
+}
+
+static void writeJsonSummary(std::ostream& out, const char* name, const HistogramSnapshot& h, double scale) {
+    out << "  \"" << name << "\": {\"count\": " << h.count << ", \"mean\": " << h.mean() / scale
+        << ", \"p50\": " << h.percentile(0.5) / scale << ", \"p90\": " << h.percentile(0.9) / scale
+        << ", \"p99\": " << h.percentile(0.99) / scale << ", \"max\": " << h.max / scale << "},\n";
+}
+
+std::string formatMetricsJson(const MetricsSnapshot& snapshot) {
+    std::ostringstream out;
+    out << "{\n  \"counters\": {";
+    for (int i = 0; i < static_cast<int>(Counter::kCount); ++i) {
+        out << (i ? ", " : "") << "\"" << counterName(static_cast<Counter>(i)) << "\": " << snapshot.counters[i];
+    }
+    out << "},\n";
+    writeJsonSummary(out, "lock_wait_us", snapshot.waitNs, 1e3);
+    writeJsonSummary(out, "detection_us", snapshot.detectionNs, 1e3);
+    writeJsonSummary(out, "cycle_length", snapshot.cycleLength, 1);
+    writeJsonSummary(out, "cycle_check_us", snapshot.cycleCheckNs, 1e3);
+    out << "  \"hot_items\": [";
+    for (size_t i = 0; i < snapshot.hotItems.size(); ++i) {
+        out << (i ? ", " : "") << "{\"did\": " << snapshot.hotItems[i].first
+            << ", \"waits\": " << snapshot.hotItems[i].second << "}";
+    }
+    out << "]\n}\n";
+    return out.str();
+}
+
+static void writePrometheusSummary(std::ostream& out, const std::string& name, const char* help,
+                                   const HistogramSnapshot& h, double scale) {
+    out << "# HELP " << name << " " << help << "\n# TYPE " << name << " summary\n";
+    for (double q : {0.5, 0.9, 0.99}) out << name << "{quantile=\"" << q << "\"} " << h.percentile(q) / scale << "\n";
+    out << name << "_sum " << h.sum / scale << "\n" << name << "_count " << h.count << "\n";
+}
+
+std::string formatMetricsPrometheus(const MetricsSnapshot& snapshot) {
+    std::ostringstream out;
+    for (int i = 0; i < static_cast<int>(Counter::kCount); ++i) {
+        std::string name = std::string("deadlock_") + counterName(static_cast<Counter>(i)) + "_total";
+        out << "# TYPE " << name << " counter\n" << name << " " << snapshot.counters[i] << "\n";
+    }
+    writePrometheusSummary(out, "deadlock_lock_wait_seconds", "Time from queueing a lock request to its grant.",
+                           snapshot.waitNs, 1e9);
+    writePrometheusSummary(out, "deadlock_detection_seconds", "Graph search time of one detection call.",
+                           snapshot.detectionNs, 1e9);
+    writePrometheusSummary(out, "deadlock_cycle_length", "Transactions per deadlock cycle or group.",
+                           snapshot.cycleLength, 1);
+    writePrometheusSummary(out, "deadlock_cycle_check_seconds",
+                           "Online search time for cycles closed by one change to an item's waits.",
+                           snapshot.cycleCheckNs, 1e9);
+    out << "# HELP deadlock_item_waits_total Requests that waited, for the busiest data items.\n"
+        << "# TYPE deadlock_item_waits_total counter\n";
+    for (const auto& item : snapshot.hotItems) {
+        out << "deadlock_item_waits_total{did=\"" << item.first << "\"} " << item.second << "\n";
+    }
+    return out.str();
+}
+
+// Moves `from` over `to`, replacing it. std::rename fails on Windows when
+// `to` exists, which it does from the second export on.
+static bool replaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+bool writeMetrics(const MetricsSnapshot& snapshot, const std::string& path, std::string& log) {
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            log = "Cannot write " + temporary;
+            return false;
+        }
+        out << (json ? formatMetricsJson(snapshot) : formatMetricsPrometheus(snapshot));
+        if (!out.flush()) {
+            log = "Cannot write " + temporary;
+            return false;
+        }
+    }
+    if (!replaceFile(temporary, path)) {
+        std::remove(temporary.c_str());
+        log = "Cannot replace " + path;
+        return false;
+    }
+    log = "Wrote " + std::string(json ? "JSON" : "Prometheus") + " metrics to " + path;
+    return true;
+}
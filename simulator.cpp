@@ -0,0 +1,387 @@
+#include "Simulator.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <thread>
+#include "DeadlockDetector.h"
+
+namespace {
+
+const char* const kPreventionNames[] = {"none", "ordering", "wait-die", "wound-wait", "avoidance"};
+const char* const kVictimNames[] = {"youngest", "fewest-locks", "least-work", "weighted"};
+
+// First delay before retrying a failed attempt; it doubles with each
+// further failure, up to 64 times this.
+const int kBackoffUs = 10;
+
+template <size_t N>
+int indexOf(const char* const (&names)[N], const std::string& name) {
+    for (size_t i = 0; i < N; ++i) {
+        if (name == names[i]) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+bool parseMode(const std::string& name, LockMode& mode) {
+    for (int m = 0; m <= static_cast<int>(LockMode::SharedIntentionExclusive); ++m) {
+        if (name == lockModeName(static_cast<LockMode>(m))) {
+            mode = static_cast<LockMode>(m);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseInt(const std::string& text, int& value) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (*end != '\0' || parsed < 0 || parsed > 0x7fffffff) return false;
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+std::vector<std::string> split(const std::string& text, char separator) {
+    std::vector<std::string> fields;
+    std::string field;
+    std::istringstream in(text);
+    while (std::getline(in, field, separator)) {
+        field.erase(0, field.find_first_not_of(" \t\r"));
+        field.erase(field.find_last_not_of(" \t\r") + 1);
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+bool writeTrace(const std::string& path, const std::vector<std::pair<int, SimTransaction>>& transactions,
+                std::string& log) {
+    std::ofstream out(path);
+    if (!out) {
+        log = "Cannot write " + path;
+        return false;
+    }
+    out << "txn,item,mode,think_us\n";
+    for (const auto& entry : transactions) {
+        for (const SimOp& op : entry.second.ops) {
+            out << entry.first << "," << op.item << "," << lockModeName(op.mode) << "," << op.thinkUs << "\n";
+        }
+    }
+    out.close();
+    if (!out) {
+        log = "Cannot write " + path;
+        return false;
+    }
+    log = "Wrote " + std::to_string(transactions.size()) + " transactions to " + path;
+    return true;
+}
+
+double ms(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+} // namespace
+
+std::string SimPolicy::name() const {
+    std::string text = kPreventionNames[static_cast<int>(prevention)];
+    if (detection == Detection::Online) return text + "/online";
+    text += detection == Detection::Fixed ? "/fixed:" : "/adaptive:";
+    return text + std::to_string(intervalMs) + "/" + kVictimNames[static_cast<int>(victim)];
+}
+
+WorkloadSimulator::WorkloadSimulator(int concurrency, int maxRetries)
+    : items(0), concurrency(std::max(1, concurrency)), maxRetries(maxRetries) {}
+
+void WorkloadSimulator::generate(const WorkloadOptions& options) {
+    std::mt19937 rng(options.seed);
+    items = std::max(1, options.items);
+    int minLocks = std::min(std::max(1, options.minLocks), items);
+    int maxLocks = std::min(std::max(minLocks, options.maxLocks), items);
+    // Cumulative Zipf weights by rank, and a shuffle so the hot items are
+    // not simply the lowest DIDs
+    std::vector<double> cumulative(items);
+    double total = 0;
+    for (int rank = 0; rank < items; ++rank) {
+        total += 1 / std::pow(rank + 1.0, options.skew);
+        cumulative[rank] = total;
+    }
+    std::vector<int> itemOfRank(items);
+    for (int i = 0; i < items; ++i) itemOfRank[i] = i;
+    std::shuffle(itemOfRank.begin(), itemOfRank.end(), rng);
+    std::uniform_real_distribution<double> unit(0, 1);
+    std::exponential_distribution<double> think(options.thinkUs > 0 ? 1.0 / options.thinkUs : 1.0);
+
+    workload.assign(std::max(0, options.transactions), SimTransaction());
+    std::vector<char> taken(items, 0);
+    for (SimTransaction& transaction : workload) {
+        int size = minLocks + static_cast<int>(rng() % (maxLocks - minLocks + 1));
+        while (static_cast<int>(transaction.ops.size()) < size) {
+            double u = unit(rng) * total;
+            int rank = static_cast<int>(std::lower_bound(cumulative.begin(), cumulative.end(), u) - cumulative.begin());
+            int item = itemOfRank[std::min(rank, items - 1)];
+            if (taken[item]) continue; // lock sets hold distinct items
+            taken[item] = 1;
+            SimOp op;
+            op.item = item;
+            op.mode = static_cast<int>(rng() % 100) < options.writePercent ? LockMode::Exclusive : LockMode::Shared;
+            op.thinkUs = options.thinkUs > 0 ? static_cast<int>(think(rng)) : 0;
+            transaction.ops.push_back(op);
+        }
+        for (const SimOp& op : transaction.ops) taken[op.item] = 0;
+    }
+}
+
+bool WorkloadSimulator::loadTrace(const std::string& path, std::string& log) {
+    std::ifstream in(path);
+    if (!in) {
+        log = "Cannot open " + path;
+        return false;
+    }
+    return loadTrace(in, log);
+}
+
+bool WorkloadSimulator::loadTrace(std::istream& in, std::string& log) {
+    std::vector<SimTransaction> loaded;
+    std::vector<int> itemIds;
+    std::string line, label;
+    bool first = true;
+    for (int number = 1; std::getline(in, line); ++number) {
+        std::vector<std::string> fields = split(line, ',');
+        if (fields.empty() || fields[0].empty() || fields[0][0] == '#') continue;
+        bool header = first && !std::isdigit(static_cast<unsigned char>(fields[0][0]));
+        first = false;
+        if (header) continue;
+        SimOp op;
+        if (fields.size() < 3 || fields.size() > 4 || !parseInt(fields[1], op.item) ||
+            !parseMode(fields[2], op.mode) || (fields.size() == 4 && !parseInt(fields[3], op.thinkUs))) {
+            log = "Malformed trace line " + std::to_string(number) + ": " + line;
+            return false;
+        }
+        if (loaded.empty() || fields[0] != label) loaded.emplace_back();
+        label = fields[0];
+        loaded.back().ops.push_back(op);
+        itemIds.push_back(op.item);
+    }
+    if (loaded.empty()) {
+        log = "Trace has no lock requests";
+        return false;
+    }
+    // Item IDs in a trace are arbitrary, and run() creates one data item per
+    // DID, so number the distinct ones densely, keeping their order for lock
+    // ordering
+    std::sort(itemIds.begin(), itemIds.end());
+    itemIds.erase(std::unique(itemIds.begin(), itemIds.end()), itemIds.end());
+    for (SimTransaction& transaction : loaded) {
+        for (SimOp& op : transaction.ops) {
+            op.item = static_cast<int>(std::lower_bound(itemIds.begin(), itemIds.end(), op.item) - itemIds.begin());
+        }
+    }
+    workload.swap(loaded);
+    items = static_cast<int>(itemIds.size());
+    log = "Loaded " + std::to_string(workload.size()) + " transactions over " + std::to_string(items) + " items";
+    return true;
+}
+
+bool WorkloadSimulator::saveTrace(const std::string& path, std::string& log) const {
+    std::vector<std::pair<int, SimTransaction>> labelled;
+    labelled.reserve(workload.size());
+    for (size_t i = 0; i < workload.size(); ++i) labelled.emplace_back(static_cast<int>(i), workload[i]);
+    return writeTrace(path, labelled, log);
+}
+
+SimResult WorkloadSimulator::run(const SimPolicy& policy) const {
+    LockManager manager;
+    manager.setBlocking(true);
+    manager.setPreventionMode(policy.prevention);
+    manager.setVictimPolicy(policy.victim);
+    for (int i = 0; i < items; ++i) manager.addDataItem();
+    DeadlockDetector detector(manager);
+    if (policy.detection != SimPolicy::Detection::Online) {
+        manager.setOnlineResolution(false);
+        if (policy.detection == SimPolicy::Detection::Adaptive) {
+            detector.setAdaptive(std::chrono::milliseconds(1), std::chrono::milliseconds(policy.intervalMs));
+        } else {
+            detector.setFixedInterval(std::chrono::milliseconds(policy.intervalMs));
+        }
+        detector.start();
+    }
+
+    std::atomic<int> next(0);
+    std::atomic<long> committed(0), aborts(0), gaveUp(0);
+    std::atomic<std::int64_t> blockedNs(0);
+    std::vector<std::thread> workers;
+    auto began = std::chrono::steady_clock::now();
+    for (int w = 0; w < concurrency; ++w) {
+        workers.emplace_back([&] {
+            std::vector<SimOp> ops;
+            std::vector<int> claims, locked;
+            for (;;) {
+                int index = next++;
+                if (index >= static_cast<int>(workload.size())) break;
+                ops = workload[index].ops;
+                if (policy.prevention == PreventionMode::LockOrdering) {
+                    std::stable_sort(ops.begin(), ops.end(),
+                                     [](const SimOp& a, const SimOp& b) { return a.item < b.item; });
+                }
+                claims.clear();
+                LockMode claimMode = LockMode::Shared;
+                if (policy.prevention == PreventionMode::Avoidance) {
+                    for (const SimOp& op : ops) {
+                        claims.push_back(op.item);
+                        if (op.mode != LockMode::Shared && op.mode != LockMode::IntentionShared) {
+                            claimMode = LockMode::Exclusive;
+                        }
+                    }
+                }
+                int tid = manager.addTransaction(claims, claimMode);
+                for (int attempt = 0;; ++attempt) {
+                    bool done = true;
+                    locked.clear();
+                    for (const SimOp& op : ops) {
+                        if (op.thinkUs > 0) std::this_thread::sleep_for(std::chrono::microseconds(op.thinkUs));
+                        auto asked = std::chrono::steady_clock::now();
+                        bool granted = manager.requestLock(tid, op.item, op.mode);
+                        blockedNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                         std::chrono::steady_clock::now() - asked)
+                                         .count();
+                        if (!granted) {
+                            done = false;
+                            break;
+                        }
+                        locked.push_back(op.item);
+                    }
+                    if (done && manager.commitTransaction(tid)) {
+                        ++committed;
+                        break;
+                    }
+                    ++aborts;
+                    if (attempt >= maxRetries) {
+                        manager.abortTransaction(tid);
+                        ++gaveUp;
+                        break;
+                    }
+                    // Start over under the same TID: a victim is restarted with
+                    // nothing held, a refused one gives its locks back
+                    if (!manager.restartTransaction(tid)) {
+                        for (auto it = locked.rbegin(); it != locked.rend(); ++it) manager.releaseLock(tid, *it);
+                    }
+                    // Back off so whatever refused it can finish first
+                    std::this_thread::sleep_for(std::chrono::microseconds(kBackoffUs << std::min(attempt, 6)));
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    auto finished = std::chrono::steady_clock::now();
+    detector.stop();
+
+    SimResult result;
+    result.policy = policy.name();
+    result.transactions = static_cast<long>(workload.size());
+    result.committed = committed;
+    result.aborts = aborts;
+    result.gaveUp = gaveUp;
+    result.seconds = ms(finished - began) / 1e3;
+    result.blockedMs = blockedNs / 1e6;
+    MetricsSnapshot metrics;
+    manager.snapshotMetrics(metrics, 0);
+    result.waitP99Us = metrics.waitNs.percentile(0.99) / 1e3;
+    result.deadlocksFormed = static_cast<long>(metrics[Counter::DeadlocksFormed]);
+    result.victims = static_cast<long>(metrics[Counter::Victims] + metrics[Counter::WaitDieAborts] +
+                                       metrics[Counter::Wounds]);
+    DetectorStats detectorStats = detector.stats();
+    result.detectionMs = detectorStats.detectionMs;
+    result.detectionCpuMs = detectorStats.detectionCpuMs;
+    result.cycleCheckMs = metrics.cycleCheckNs.sum / 1e6;
+    return result;
+}
+
+bool WorkloadSimulator::parsePolicy(const std::string& spec, SimPolicy& policy, std::string& log) {
+    std::vector<std::string> parts = split(spec, '/');
+    SimPolicy parsed;
+    int prevention = parts.empty() ? -1 : indexOf(kPreventionNames, parts[0]);
+    if (prevention < 0 || parts.size() > 3) {
+        log = "Unknown policy " + spec;
+        return false;
+    }
+    parsed.prevention = static_cast<PreventionMode>(prevention);
+    if (parts.size() > 1 && parts[1] != "online") {
+        std::vector<std::string> detection = split(parts[1], ':');
+        if (detection.empty() || detection.size() > 2 || (detection[0] != "fixed" && detection[0] != "adaptive") ||
+            (detection.size() == 2 && (!parseInt(detection[1], parsed.intervalMs) || parsed.intervalMs < 1))) {
+            log = "Unknown detection " + parts[1] + " in policy " + spec;
+            return false;
+        }
+        parsed.detection = detection[0] == "fixed" ? SimPolicy::Detection::Fixed : SimPolicy::Detection::Adaptive;
+    }
+    if (parts.size() > 2) {
+        int victim = indexOf(kVictimNames, parts[2]);
+        if (victim < 0 || parsed.detection == SimPolicy::Detection::Online) {
+            log = "Unknown victim policy " + parts[2] + " in policy " + spec + " (needs fixed or adaptive detection)";
+            return false;
+        }
+        parsed.victim = static_cast<VictimPolicy>(victim);
+    }
+    policy = parsed;
+    return true;
+}
+
+std::vector<SimPolicy> WorkloadSimulator::defaultPolicies() {
+    std::vector<SimPolicy> policies;
+    for (int prevention = 0; prevention <= static_cast<int>(PreventionMode::Avoidance); ++prevention) {
+        SimPolicy policy;
+        policy.prevention = static_cast<PreventionMode>(prevention);
+        policies.push_back(policy);
+    }
+    for (int interval : {1, 10, 100}) {
+        SimPolicy policy;
+        policy.detection = SimPolicy::Detection::Fixed;
+        policy.intervalMs = interval;
+        policies.push_back(policy);
+    }
+    for (int victim = 0; victim <= static_cast<int>(VictimPolicy::WeightedCost); ++victim) {
+        SimPolicy policy;
+        policy.detection = SimPolicy::Detection::Adaptive;
+        policy.victim = static_cast<VictimPolicy>(victim);
+        policies.push_back(policy);
+    }
+    return policies;
+}
+
+std::string WorkloadSimulator::csvHeader() {
+    return "policy,transactions,committed,aborts,gave_up,elapsed_s,throughput_tps,abort_rate,"
+           "blocked_ms_per_txn,wait_p99_us,deadlocks_formed,victims,detection_ms,detection_cpu_ms,"
+           "cycle_check_ms";
+}
+
+std::string WorkloadSimulator::csvRow(const SimResult& result) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3) << result.policy << "," << result.transactions << ","
+        << result.committed << "," << result.aborts << "," << result.gaveUp << "," << result.seconds << ","
+        << result.throughput() << "," << result.abortRate() << "," << result.blockedMsPerTransaction() << ","
+        << result.waitP99Us << "," << result.deadlocksFormed << "," << result.victims << ","
+        << result.detectionMs << "," << result.detectionCpuMs << "," << result.cycleCheckMs;
+    return out.str();
+}
+
+void TraceRecorder::add(int tid, SimTransaction transaction) {
+    if (transaction.ops.empty()) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    finished.emplace_back(tid, std::move(transaction));
+}
+
+long TraceRecorder::transactionCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return static_cast<long>(finished.size());
+}
+
+bool TraceRecorder::save(const std::string& path, std::string& log) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return writeTrace(path, finished, log);
+}
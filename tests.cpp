@@ -0,0 +1,594 @@
+#include "DeadlockCore.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Deterministic checks of the core, run by ctest. Each group is one ctest
+// test, named by the argument that selects it; without arguments every
+// group runs. Failed checks are printed and make the exit status nonzero.
+
+static int failures = 0;
+
+#define CHECK(cond)                                                                       \
+    do {                                                                                  \
+        if (!(cond)) {                                                                    \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond "\n";  \
+            ++failures;                                                                   \
+        }                                                                                 \
+    } while (0)
+
+static std::vector<int> sorted(std::vector<int> ids) {
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+static std::vector<int> toVector(const IdSet& ids) {
+    return std::vector<int>(ids.begin(), ids.end());
+}
+
+static void testLockModes() {
+    const LockMode S = LockMode::Shared, X = LockMode::Exclusive, IS = LockMode::IntentionShared,
+                   IX = LockMode::IntentionExclusive, SIX = LockMode::SharedIntentionExclusive;
+    const LockMode modes[] = {S, X, IS, IX, SIX};
+    // Rows are held modes, columns requested ones, in the order above
+    const bool expected[5][5] = {
+        { true, false,  true, false, false},
+        {false, false, false, false, false},
+        { true, false,  true,  true,  true},
+        {false, false,  true,  true, false},
+        {false, false,  true, false, false},
+    };
+    for (int h = 0; h < 5; ++h) {
+        for (int r = 0; r < 5; ++r) {
+            CHECK(lockModesCompatible(modes[h], modes[r]) == expected[h][r]);
+            // Compatibility is symmetric
+            CHECK(lockModesCompatible(modes[h], modes[r]) == lockModesCompatible(modes[r], modes[h]));
+            LockMode sup = lockModeSupremum(modes[h], modes[r]);
+            CHECK(sup == lockModeSupremum(modes[r], modes[h]));
+            CHECK(lockModeCovers(sup, modes[h]) && lockModeCovers(sup, modes[r]));
+            // A request is compatible with the group mode exactly when it is
+            // compatible with both holders
+            for (int q = 0; q < 5; ++q) {
+                bool both = lockModesCompatible(modes[h], modes[q]) && lockModesCompatible(modes[r], modes[q]);
+                CHECK(lockModesCompatible(sup, modes[q]) == both);
+            }
+        }
+    }
+    CHECK(lockModeSupremum(S, IX) == SIX);
+    CHECK(lockModeSupremum(IS, S) == S);
+    CHECK(lockModeSupremum(IS, IX) == IX);
+    CHECK(lockModeSupremum(SIX, X) == X);
+    CHECK(intentionFor(S) == IS && intentionFor(X) == IX && intentionFor(SIX) == IX);
+}
+
+static void testComponents() {
+    WaitForGraph g;
+    // Two deadlocked groups joined by a one-way wait, plus waits in no cycle
+    const std::pair<int, int> waits[] = {{0, 1}, {1, 2}, {2, 0}, {2, 3}, {3, 4}, {4, 3}, {5, 6}, {6, 3}};
+    for (const auto& w : waits) g.addEdge(w.first, w.second);
+    auto components = g.deadlockedComponents();
+    std::sort(components.begin(), components.end());
+    CHECK(components == (std::vector<std::vector<int>>{{0, 1, 2}, {3, 4}}));
+
+    auto sameCost = [](int) { return 1.0; };
+    // Waits out of a group do not count, so every member ties and the
+    // highest node ID goes
+    CHECK(sorted(g.breakingSet(components, sameCost)) == (std::vector<int>{2, 4}));
+    // Cost decides before age, age before node ID
+    CHECK(sorted(g.breakingSet(components, [](int t) { return t == 3 ? 0.5 : 1.0; })) == (std::vector<int>{2, 3}));
+    CHECK(sorted(g.breakingSet(components, sameCost, [](int t) { return t == 0 || t == 3 ? 10L : 1L; })) ==
+          (std::vector<int>{0, 3}));
+
+    // A hub in every cycle breaks them all on its own
+    WaitForGraph hub;
+    for (int t = 1; t <= 3; ++t) {
+        hub.addEdge(0, t);
+        hub.addEdge(t, 0);
+    }
+    hub.addEdge(1, 2);
+    auto hubComponents = hub.deadlockedComponents();
+    CHECK(hubComponents == (std::vector<std::vector<int>>{{0, 1, 2, 3}}));
+    CHECK(hub.breakingSet(hubComponents, sameCost) == (std::vector<int>{0}));
+    // Unless the hub is starving: cost goes first, so the others are aborted
+    // around it, however many that takes
+    auto starving = [](int t) { return t == 0 ? 1e12 : 1.0; };
+    CHECK(hub.breakingSet(hubComponents, starving) == (std::vector<int>{1, 2, 3}));
+
+    hub.removeEdge(0, 1);
+    hub.removeEdge(0, 2);
+    hub.removeEdge(0, 3);
+    CHECK(hub.deadlockedComponents().empty());
+    CHECK(!hub.hasCycle());
+}
+
+// True if `cycle` is [t, ..., t] over edges of `g`.
+static bool validCycle(const WaitForGraph& g, const std::vector<int>& cycle) {
+    if (cycle.size() < 2 || cycle.front() != cycle.back()) return false;
+    for (std::size_t i = 0; i + 1 < cycle.size(); ++i) {
+        if (!g.hasEdge(cycle[i], cycle[i + 1])) return false;
+    }
+    return true;
+}
+
+static void testEngines() {
+    std::mt19937 rng(7);
+    WaitForGraph lists, matrix;
+    lists.setEngine(WaitForGraph::Engine::Lists);
+    matrix.setEngine(WaitForGraph::Engine::Matrix);
+    for (int round = 0; round < 300; ++round) {
+        // Sizes alternate between large and small every ten rounds, so the
+        // storage kept across clear() is both too small and too big
+        int nodes = 2 + static_cast<int>(rng() % (round % 20 < 10 ? 150 : 12));
+        int edges = static_cast<int>(rng() % (nodes + 1));
+        for (int e = 0; e < edges; ++e) {
+            int from = static_cast<int>(rng() % nodes), to = static_cast<int>(rng() % nodes);
+            if (from == to) continue;
+            bool fresh = lists.addEdge(from, to);
+            CHECK(matrix.addEdge(from, to) == fresh);
+            if (fresh) {
+                auto viaLists = lists.findCycleThrough(from, to);
+                auto viaMatrix = matrix.findCycleThrough(from, to);
+                CHECK(viaLists.empty() == viaMatrix.empty());
+                if (!viaMatrix.empty()) {
+                    CHECK(viaMatrix[0] == from && viaMatrix[1] == to && validCycle(matrix, viaMatrix));
+                    // Drop the edge again, as online detection refuses it
+                    lists.removeEdge(from, to);
+                    matrix.removeEdge(from, to);
+                }
+            }
+        }
+        CHECK(lists.size() == matrix.size());
+        CHECK(lists.edges() == matrix.edges());
+        CHECK(!lists.hasCycle() && !matrix.hasCycle());
+
+        // Now allow cycles
+        for (int e = 0; e < 3; ++e) {
+            int from = static_cast<int>(rng() % nodes), to = static_cast<int>(rng() % nodes);
+            if (from == to) continue;
+            lists.addEdge(from, to);
+            matrix.addEdge(from, to);
+        }
+        bool cyclic = lists.hasCycle();
+        CHECK(matrix.hasCycle() == cyclic);
+        auto viaLists = lists.findCycle();
+        auto viaMatrix = matrix.findCycle();
+        CHECK(viaLists.empty() == !cyclic && viaMatrix.empty() == !cyclic);
+        if (cyclic) CHECK(validCycle(lists, viaLists) && validCycle(matrix, viaMatrix));
+        CHECK(lists.deadlockedComponents() == matrix.deadlockedComponents());
+        lists.clear();
+        matrix.clear();
+    }
+}
+
+// Plain reachability over an edge list, to check ClaimGraph against.
+static bool reaches(const std::vector<std::pair<int, int>>& edges, int nodes, int from, int to) {
+    std::vector<bool> seen(nodes, false);
+    std::vector<int> stack{from};
+    seen[from] = true;
+    while (!stack.empty()) {
+        int node = stack.back();
+        stack.pop_back();
+        if (node == to) return true;
+        for (const auto& e : edges) {
+            if (e.first == node && !seen[e.second]) {
+                seen[e.second] = true;
+                stack.push_back(e.second);
+            }
+        }
+    }
+    return false;
+}
+
+static void testClaimGraph() {
+    // Every edge points backwards in the initial order, so each one reorders
+    ClaimGraph chain;
+    for (int t = 4; t > 0; --t) chain.addEdge(t, t - 1);
+    CHECK(chain.size() == 4);
+    CHECK(chain.reachedSource(0, {1, 2, 3, 4}) == -1);
+    CHECK(chain.reachedSource(4, {0}) == 0);
+    CHECK(chain.reachedSource(2, {0, 3}) == 0);
+    CHECK(chain.reachedSource(5, {0, 1}) == -1);
+    chain.removeEdge(2, 1);
+    CHECK(chain.reachedSource(4, {0}) == -1);
+    CHECK(chain.reachedSource(4, {2}) == 2);
+
+    // Random traffic as avoidance makes it: edges into a node from a set of
+    // sources, added only if they keep the graph acyclic, plus removals and
+    // now and then an edge that may close a cycle
+    const int nodes = 12;
+    std::mt19937 rng(11);
+    ClaimGraph g;
+    std::vector<std::pair<int, int>> edges;
+    for (int step = 0; step < 4000; ++step) {
+        unsigned action = rng() % 10;
+        if (action < 3 && !edges.empty()) {
+            std::size_t i = rng() % edges.size();
+            g.removeEdge(edges[i].first, edges[i].second);
+            edges.erase(edges.begin() + i);
+            continue;
+        }
+        int to = static_cast<int>(rng() % nodes);
+        if (action == 3) {
+            int from = static_cast<int>(rng() % nodes);
+            if (from == to) continue;
+            g.addEdge(from, to);
+            edges.push_back({from, to});
+            continue;
+        }
+        std::vector<int> sources;
+        for (int s = 0; s < nodes; ++s) {
+            if (s != to && rng() % 4 == 0) sources.push_back(s);
+        }
+        bool expected = false;
+        for (int s : sources) expected = expected || reaches(edges, nodes, to, s);
+        int reached = g.reachedSource(to, sources);
+        CHECK((reached != -1) == expected);
+        if (reached != -1) {
+            CHECK(std::binary_search(sources.begin(), sources.end(), reached));
+            CHECK(reaches(edges, nodes, to, reached));
+        } else {
+            for (int s : sources) {
+                g.addEdge(s, to);
+                edges.push_back({s, to});
+            }
+        }
+        auto distinct = edges;
+        std::sort(distinct.begin(), distinct.end());
+        CHECK(g.size() == static_cast<std::size_t>(std::unique(distinct.begin(), distinct.end()) - distinct.begin()));
+    }
+}
+
+static void testUpgrades() {
+    LockManager m;
+    int d = m.addDataItem();
+    int t0 = m.addTransaction(), t1 = m.addTransaction(), t2 = m.addTransaction();
+    CHECK(m.requestLock(t0, d, LockMode::Shared));
+    CHECK(m.requestLock(t1, d, LockMode::Shared));
+    CHECK(!m.requestLock(t2, d, LockMode::Exclusive));
+    // T0 converts to X; it goes ahead of T2, which would otherwise deadlock it
+    CHECK(!m.requestLock(t0, d, LockMode::Exclusive));
+    CHECK(toVector(m.waitingFor(t0)) == (std::vector<int>{d}));
+    CHECK(toVector(m.waitingFor(t2)) == (std::vector<int>{d}));
+    CHECK(toVector(m.lockHolders(d)) == sorted({t0, t1}));
+    CHECK(!m.getWaitForGraph().hasCycle());
+
+    m.releaseLock(t1, d);
+    CHECK(toVector(m.lockHolders(d)) == (std::vector<int>{t0}));
+    CHECK(m.heldMode(t0, d) == LockMode::Exclusive);
+    CHECK(m.waitingFor(t0).empty());
+    CHECK(toVector(m.waitingFor(t2)) == (std::vector<int>{d}));
+
+    m.releaseLock(t0, d);
+    CHECK(toVector(m.lockHolders(d)) == (std::vector<int>{t2}));
+    CHECK(m.heldMode(t2, d) == LockMode::Exclusive);
+    CHECK(m.waitingFor(t2).empty());
+}
+
+static void testAvoidance() {
+    // Test Case 32: a grant that is unsafe for now waits and is made once
+    // the claim that made it unsafe is gone
+    LockManager m;
+    m.setPreventionMode(PreventionMode::Avoidance);
+    int d0 = m.addDataItem(), d1 = m.addDataItem(), d2 = m.addDataItem();
+    int t0 = m.addTransaction({d0, d1}), t1 = m.addTransaction({d0, d1});
+    CHECK(m.requestLock(t0, d0));
+    CHECK(!m.requestLock(t1, d1));
+    CHECK(toVector(m.waitingFor(t1)) == (std::vector<int>{d1}));
+    CHECK(m.lockHolders(d1).empty());
+    CHECK(!m.requestLock(t1, d2)); // outside its claims
+    CHECK(m.requestLock(t0, d1));
+    m.releaseLock(t0, d0);
+    CHECK(toVector(m.waitingFor(t1)) == (std::vector<int>{d1}));
+    m.releaseLock(t0, d1);
+    CHECK(toVector(m.lockHolders(d1)) == (std::vector<int>{t1}));
+    CHECK(m.waitingFor(t1).empty());
+
+    MetricsSnapshot metrics;
+    m.snapshotMetrics(metrics, 1);
+    CHECK(metrics[Counter::UnsafeDeferrals] == 1);
+    CHECK(metrics[Counter::DeadlocksFormed] == 0);
+}
+
+static void testPrevention() {
+    // Wait-die: an older requester waits, a younger one is aborted
+    {
+        LockManager m;
+        m.setPreventionMode(PreventionMode::WaitDie);
+        int d0 = m.addDataItem(), d1 = m.addDataItem();
+        int older = m.addTransaction(), younger = m.addTransaction();
+        CHECK(m.requestLock(older, d0));
+        CHECK(m.requestLock(younger, d1));
+        CHECK(!m.requestLock(older, d1));
+        CHECK(toVector(m.waitingFor(older)) == (std::vector<int>{d1}));
+        CHECK(!m.requestLock(younger, d0));
+        CHECK(!m.isActive(younger));
+        CHECK(m.heldLocks(younger).empty() && m.waitingFor(younger).empty());
+        // What it held goes to the older waiter
+        CHECK(toVector(m.lockHolders(d1)) == (std::vector<int>{older}));
+        CHECK(m.waitingFor(older).empty());
+        MetricsSnapshot metrics;
+        m.snapshotMetrics(metrics, 0);
+        CHECK(metrics[Counter::WaitDieAborts] == 1);
+        CHECK(metrics[Counter::DeadlocksFormed] == 0);
+    }
+    // Wound-wait: an older requester aborts the younger holder, a younger
+    // one waits
+    {
+        LockManager m;
+        m.setPreventionMode(PreventionMode::WoundWait);
+        int d0 = m.addDataItem(), d1 = m.addDataItem();
+        int older = m.addTransaction(), younger = m.addTransaction();
+        CHECK(m.requestLock(older, d0));
+        CHECK(m.requestLock(younger, d1));
+        CHECK(!m.requestLock(younger, d0));
+        CHECK(m.isActive(younger));
+        CHECK(toVector(m.waitingFor(younger)) == (std::vector<int>{d0}));
+        CHECK(m.requestLock(older, d1));
+        CHECK(!m.isActive(younger));
+        CHECK(m.heldLocks(younger).empty() && m.waitingFor(younger).empty());
+        CHECK(toVector(m.heldLocks(older)) == (std::vector<int>{d0, d1}));
+        MetricsSnapshot metrics;
+        m.snapshotMetrics(metrics, 0);
+        CHECK(metrics[Counter::Wounds] == 1);
+        CHECK(metrics[Counter::DeadlocksFormed] == 0);
+
+        // Restarted, the wounded transaction keeps its age and waits again
+        CHECK(m.restartTransaction(younger));
+        CHECK(!m.requestLock(younger, d1));
+        CHECK(toVector(m.waitingFor(younger)) == (std::vector<int>{d1}));
+        m.releaseLock(older, d1);
+        CHECK(toVector(m.lockHolders(d1)) == (std::vector<int>{younger}));
+    }
+}
+
+static void testEscalation() {
+    LockManager m;
+    m.setEscalationThreshold(3);
+    int table = m.addDataItem();
+    std::vector<int> rows;
+    for (int i = 0; i < 5; ++i) rows.push_back(m.addDataItem(table));
+    int t0 = m.addTransaction(), t1 = m.addTransaction();
+
+    // Below the threshold the rows are locked one by one under IS
+    CHECK(m.requestLock(t0, rows[0], LockMode::Shared));
+    CHECK(m.requestLock(t0, rows[1], LockMode::Shared));
+    CHECK(m.heldMode(t0, table) == LockMode::IntentionShared);
+    CHECK(toVector(m.heldLocks(t0)) == (std::vector<int>{table, rows[0], rows[1]}));
+    // The third one swaps them for S on the table
+    CHECK(m.requestLock(t0, rows[2], LockMode::Shared));
+    CHECK(m.heldMode(t0, table) == LockMode::Shared);
+    CHECK(toVector(m.heldLocks(t0)) == (std::vector<int>{table}));
+    // Rows under it are still read without new locks, and a writer waits
+    CHECK(m.requestLock(t0, rows[3], LockMode::Shared));
+    CHECK(!m.requestLock(t1, rows[4], LockMode::Exclusive));
+    CHECK(toVector(m.waitingFor(t1)) == (std::vector<int>{table}));
+    MetricsSnapshot metrics;
+    m.snapshotMetrics(metrics, 0);
+    CHECK(metrics[Counter::Escalations] == 1);
+    m.releaseLock(t0, table);
+    // The queued intention lock is granted; a non-blocking caller then asks
+    // for the row again
+    CHECK(m.heldMode(t1, table) == LockMode::IntentionExclusive);
+    CHECK(m.requestLock(t1, rows[4], LockMode::Exclusive));
+    CHECK(toVector(m.heldLocks(t1)) == (std::vector<int>{table, rows[4]}));
+
+    // No escalation while the table lock would have to wait
+    LockManager busy;
+    busy.setEscalationThreshold(2);
+    table = busy.addDataItem();
+    rows.clear();
+    for (int i = 0; i < 3; ++i) rows.push_back(busy.addDataItem(table));
+    t0 = busy.addTransaction();
+    t1 = busy.addTransaction();
+    CHECK(busy.requestLock(t1, rows[2], LockMode::Exclusive));
+    CHECK(busy.requestLock(t0, rows[0], LockMode::Shared));
+    CHECK(busy.requestLock(t0, rows[1], LockMode::Shared));
+    CHECK(busy.heldMode(t0, table) == LockMode::IntentionShared);
+    CHECK(toVector(busy.heldLocks(t0)) == (std::vector<int>{table, rows[0], rows[1]}));
+    busy.snapshotMetrics(metrics, 0);
+    CHECK(metrics[Counter::Escalations] == 0);
+
+    // Off by default
+    LockManager plain;
+    table = plain.addDataItem();
+    t0 = plain.addTransaction();
+    for (int i = 0; i < 8; ++i) CHECK(plain.requestLock(t0, plain.addDataItem(table), LockMode::Shared));
+    CHECK(plain.heldLocks(t0).size() == 9);
+}
+
+// Waits up to a few seconds for `done`, polling.
+template <typename Condition>
+static bool eventually(Condition done) {
+    for (int i = 0; i < 5000 && !done(); ++i) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return done();
+}
+
+static void testBatches() {
+    // Non-blocking: a batch that cannot be granted at once takes nothing and
+    // queues nothing, and a lock it would have converted keeps its mode
+    {
+        LockManager m;
+        int d0 = m.addDataItem(), d1 = m.addDataItem(), d2 = m.addDataItem();
+        int t0 = m.addTransaction(), t1 = m.addTransaction();
+        CHECK(m.requestLock(t1, d2, LockMode::Shared));
+        CHECK(m.requestLock(t0, d0, LockMode::Shared));
+        CHECK(!m.requestLocks(t0, {d2, d1, d0}, LockMode::Exclusive));
+        CHECK(toVector(m.heldLocks(t0)) == (std::vector<int>{d0}));
+        CHECK(m.heldMode(t0, d0) == LockMode::Shared);
+        CHECK(m.waitingFor(t0).empty());
+        CHECK(m.lockHolders(d1).empty());
+        CHECK(m.requestLocks(t0, {d1, d0, d1}, LockMode::Exclusive));
+        CHECK(toVector(m.heldLocks(t0)) == (std::vector<int>{d0, d1}));
+        CHECK(m.heldMode(t0, d0) == LockMode::Exclusive);
+    }
+    // Blocking: the batch takes its items in order and waits on the first
+    // busy one; when that wait closes a cycle and is refused, the items the
+    // call took are given back and earlier locks kept
+    {
+        LockManager m;
+        m.setBlocking(true);
+        int d0 = m.addDataItem(), d1 = m.addDataItem(), d2 = m.addDataItem(), d3 = m.addDataItem();
+        int t0 = m.addTransaction(), t1 = m.addTransaction();
+        CHECK(m.requestLock(t0, d3));
+        CHECK(m.requestLock(t1, d2));
+        bool granted = false;
+        std::thread waiter([&] { granted = m.requestLock(t1, d3); });
+        CHECK(eventually([&] { return m.blockedRequestCount() == 1; }));
+        CHECK(!m.requestLocks(t0, {d0, d1, d2}));
+        CHECK(toVector(m.heldLocks(t0)) == (std::vector<int>{d3}));
+        CHECK(m.waitingFor(t0).empty());
+        CHECK(m.lockHolders(d0).empty() && m.lockHolders(d1).empty());
+        m.releaseLock(t0, d3);
+        waiter.join();
+        CHECK(granted);
+        CHECK(toVector(m.heldLocks(t1)) == (std::vector<int>{d2, d3}));
+    }
+}
+
+// True once `future` has its outcome, waiting a few seconds at most.
+static bool settled(std::future<LockOutcome>& future) {
+    return future.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+}
+
+static void testAsync() {
+    LockManager m;
+    int d0 = m.addDataItem(), d1 = m.addDataItem();
+    int t0 = m.addTransaction(), t1 = m.addTransaction(), t2 = m.addTransaction();
+
+    // Known at once: completes on the calling thread
+    auto free = m.requestLockAsync(t0, d0);
+    CHECK(free.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+    CHECK(free.get() == LockOutcome::Granted);
+
+    // A wait that outlives its timeout is withdrawn
+    auto late = m.requestLockAsync(t1, d0, LockMode::Exclusive, std::chrono::milliseconds(20));
+    CHECK(settled(late) && late.get() == LockOutcome::TimedOut);
+    CHECK(m.waitingFor(t1).empty());
+    CHECK(m.blockedRequestCount() == 0);
+
+    // Granted once the holder lets go
+    auto queued = m.requestLockAsync(t1, d0);
+    CHECK(queued.wait_for(std::chrono::milliseconds(20)) == std::future_status::timeout);
+    m.releaseLock(t0, d0);
+    CHECK(settled(queued) && queued.get() == LockOutcome::Granted);
+    CHECK(toVector(m.lockHolders(d0)) == (std::vector<int>{t1}));
+
+    // Ending the waiting transaction completes its request: Aborted for an
+    // abort, Refused for a commit
+    auto aborted = m.requestLockAsync(t2, d0);
+    CHECK(m.abortTransaction(t2));
+    CHECK(settled(aborted) && aborted.get() == LockOutcome::Aborted);
+    int t3 = m.addTransaction();
+    auto committed = m.requestLockAsync(t3, d0);
+    CHECK(m.commitTransaction(t3));
+    CHECK(settled(committed) && committed.get() == LockOutcome::Refused);
+
+    // A deadlock victim's request completes as Aborted and the survivor's
+    // is granted. With online resolution off the cycle waits for detection,
+    // which picks the youngest.
+    m.setOnlineResolution(false);
+    int t4 = m.addTransaction();
+    CHECK(m.requestLock(t4, d1));
+    auto survivor = m.requestLockAsync(t1, d1);
+    auto victim = m.requestLockAsync(t4, d0);
+    std::vector<std::vector<int>> components;
+    CHECK(m.detectAllDeadlocks(components));
+    CHECK(components == (std::vector<std::vector<int>>{sorted({t1, t4})}));
+    std::vector<int> victims;
+    m.recoverAll(components, victims);
+    CHECK(victims == (std::vector<int>{t4}));
+    CHECK(settled(victim) && victim.get() == LockOutcome::Aborted);
+    CHECK(settled(survivor) && survivor.get() == LockOutcome::Granted);
+    CHECK(!m.isActive(t4));
+    CHECK(toVector(m.heldLocks(t1)) == (std::vector<int>{d0, d1}));
+}
+
+static void testStaleTids() {
+    LockManager m;
+    int d0 = m.addDataItem(), d1 = m.addDataItem();
+    int committed = m.addTransaction();
+    CHECK(m.requestLock(committed, d0));
+    CHECK(m.commitTransaction(committed));
+    CHECK(m.lockHolders(d0).empty());
+
+    // The slot is reused under a new TID; the old one is rejected everywhere
+    int reused = m.addTransaction();
+    CHECK(reused != committed);
+    CHECK(m.isActive(reused) && !m.isActive(committed));
+    CHECK(!m.requestLock(committed, d0));
+    CHECK(m.lockHolders(d0).empty());
+    CHECK(!m.requestLocks(committed, {d0, d1}));
+    CHECK(!m.commitTransaction(committed));
+    CHECK(!m.abortTransaction(committed));
+    CHECK(!m.restartTransaction(committed));
+    CHECK(!m.terminateVictim(committed));
+    auto future = m.requestLockAsync(committed, d1);
+    CHECK(future.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+    CHECK(future.get() == LockOutcome::Refused);
+    m.releaseLock(committed, d0);
+    // ... and none of that touched the transaction now in the slot
+    CHECK(m.isActive(reused));
+    CHECK(m.requestLock(reused, d0));
+    CHECK(m.abortTransaction(reused));
+    CHECK(!m.abortTransaction(reused));
+    CHECK(!m.requestLock(reused, d1));
+
+    // Generations wrap around below the sign bit: every TID stays
+    // non-negative, differs from the one before it, and the first comes
+    // back only after 2^11 reuses of the slot
+    LockManager wrap;
+    int first = wrap.addTransaction(), previous = first, reuses = 0;
+    CHECK(wrap.commitTransaction(first));
+    for (;;) {
+        int tid = wrap.addTransaction();
+        ++reuses;
+        CHECK(tid >= 0 && tid != previous);
+        CHECK(!wrap.commitTransaction(previous));
+        CHECK(wrap.commitTransaction(tid));
+        previous = tid;
+        if (tid == first || reuses > 5000) break;
+    }
+    CHECK(reuses == (0x7fffffff >> 20) + 1);
+}
+
+int main(int argc, char** argv) {
+    const std::pair<const char*, void (*)()> groups[] = {
+        {"lock-modes", testLockModes},
+        {"components", testComponents},
+        {"engines", testEngines},
+        {"claim-graph", testClaimGraph},
+        {"upgrades", testUpgrades},
+        {"avoidance", testAvoidance},
+        {"prevention", testPrevention},
+        {"escalation", testEscalation},
+        {"batches", testBatches},
+        {"async", testAsync},
+        {"stale-tids", testStaleTids},
+    };
+    int ran = 0;
+    for (const auto& group : groups) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i) selected = selected || std::strcmp(argv[i], group.first) == 0;
+        if (!selected) continue;
+        group.second();
+        ++ran;
+    }
+    if (ran < argc - 1 || ran == 0) {
+        std::cerr << "usage: deadlock-tests [GROUP]...\ngroups:";
+        for (const auto& group : groups) std::cerr << " " << group.first;
+        std::cerr << "\n";
+        return 2;
+    }
+    if (failures) {
+        std::cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,188 @@
+#include "Transport.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+InProcessTransport::InProcessTransport(std::vector<Handler> handlers) : handlers(std::move(handlers)) {}
+
+bool InProcessTransport::call(int node, const std::string& request, std::string& reply, std::string& log) {
+    if (node < 0 || node >= nodeCount()) {
+        log = "No node " + std::to_string(node);
+        return false;
+    }
+    reply = handlers[node](request);
+    return true;
+}
+
+#ifndef _WIN32
+
+struct LoopbackTransport::Listener {
+    Handler handler;
+    int fd = -1;
+    int port = 0;
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+};
+
+static bool sendLine(int fd, const std::string& text) {
+    std::string line = text + "\n";
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL; // a peer that hung up must not kill the process
+#else
+    const int flags = 0;
+#endif
+    size_t sent = 0;
+    while (sent < line.size()) {
+        ssize_t n = ::send(fd, line.data() + sent, line.size() - sent, flags);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool receiveLine(int fd, std::string& text) {
+    text.clear();
+    char buffer[4096];
+    for (;;) {
+        ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        text.append(buffer, static_cast<size_t>(n));
+        if (text.back() == '\n') {
+            text.pop_back();
+            return true;
+        }
+    }
+}
+
+static int connectTo(int port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void serve(LoopbackTransport::Handler handler, int listenFd, const std::atomic<bool>& stopping) {
+    // One request per connection, answered in arrival order
+    for (;;) {
+        int fd = ::accept(listenFd, nullptr, nullptr);
+        if (stopping) {
+            if (fd >= 0) ::close(fd);
+            return;
+        }
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+        std::string request;
+        if (receiveLine(fd, request)) sendLine(fd, handler(request));
+        ::close(fd);
+    }
+}
+
+LoopbackTransport::LoopbackTransport(std::vector<Handler> handlers) {
+    for (auto& handler : handlers) {
+        std::unique_ptr<Listener> listener(new Listener);
+        listener->handler = std::move(handler);
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = 0;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(fd, SOMAXCONN) != 0 ||
+            ::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+            if (error.empty()) error = std::string("Cannot listen on 127.0.0.1: ") + std::strerror(errno);
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+        }
+        listener->fd = fd;
+        listener->port = fd >= 0 ? ntohs(address.sin_port) : 0;
+        if (fd >= 0) {
+            Listener* l = listener.get();
+            l->thread = std::thread(serve, l->handler, fd, std::cref(l->stopping));
+        }
+        listeners.push_back(std::move(listener));
+    }
+}
+
+LoopbackTransport::~LoopbackTransport() {
+    for (auto& listener : listeners) {
+        if (listener->fd < 0) continue;
+        // Shutting the socket down wakes accept on Linux; elsewhere a
+        // connection of our own does
+        listener->stopping = true;
+        ::shutdown(listener->fd, SHUT_RDWR);
+        int fd = connectTo(listener->port);
+        if (fd >= 0) ::close(fd);
+        listener->thread.join();
+        ::close(listener->fd);
+    }
+}
+
+bool LoopbackTransport::call(int node, const std::string& request, std::string& reply, std::string& log) {
+    if (node < 0 || node >= nodeCount() || listeners[node]->fd < 0) {
+        log = "No node " + std::to_string(node);
+        return false;
+    }
+    int fd = connectTo(listeners[node]->port);
+    if (fd < 0) {
+        log = "Cannot connect to node " + std::to_string(node) + ": " + std::strerror(errno);
+        return false;
+    }
+    bool ok = sendLine(fd, request) && receiveLine(fd, reply);
+    ::close(fd);
+    if (!ok) log = "Lost connection to node " + std::to_string(node);
+    return ok;
+}
+
+#else
+
+struct LoopbackTransport::Listener {
+    Handler handler;
+    int port = 0;
+};
+
+LoopbackTransport::LoopbackTransport(std::vector<Handler> handlers)
+    : error("Loopback sockets are not supported on this platform") {
+    for (auto& handler : handlers) {
+        std::unique_ptr<Listener> listener(new Listener);
+        listener->handler = std::move(handler);
+        listeners.push_back(std::move(listener));
+    }
+}
+
+LoopbackTransport::~LoopbackTransport() {}
+
+bool LoopbackTransport::call(int, const std::string&, std::string&, std::string& log) {
+    log = error;
+    return false;
+}
+
+#endif
+
+bool LoopbackTransport::ready(std::string& log) const {
+    log = error;
+    return error.empty();
+}
+
+int LoopbackTransport::port(int node) const {
+    return node >= 0 && node < nodeCount() ? listeners[node]->port : 0;
+}
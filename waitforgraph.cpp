@@ -0,0 +1,338 @@
+#include "WaitForGraph.h"
+#include <algorithm>
+#include <utility>
+
+// Searches use the matrix once the average out-degree reaches half the
+// words in a matrix row, and at least 2; measured, that is where a full
+// search over random graphs takes about as long either way.
+static std::size_t denseDegree(std::size_t nodes) {
+    return std::max<std::size_t>(2, (nodes + 63) / 64 / 2);
+}
+
+WaitForGraph::WaitForGraph() : edgeCount(0), activeNodes(0), epoch(0), engine(Engine::Auto), matrixBuilt(false) {}
+
+void WaitForGraph::reserveNode(int tid) {
+    if (tid >= static_cast<int>(adj.size())) {
+        adj.resize(tid + 1);
+        mark.resize(tid + 1, 0);
+        parent.resize(tid + 1, -1);
+    }
+    if (tid >= activeNodes) {
+        activeNodes = tid + 1;
+        if (matrixBuilt && !matrix.reserve(activeNodes)) matrixBuilt = false; // outgrew it
+    }
+}
+
+bool WaitForGraph::useMatrix() const {
+    std::size_t nodes = static_cast<std::size_t>(activeNodes);
+    if (engine == Engine::Lists || nodes == 0 || nodes > static_cast<std::size_t>(BitGraph::kMaxNodes)) return false;
+    if (engine == Engine::Auto && edgeCount < nodes * denseDegree(nodes)) return false;
+    if (!matrixBuilt) {
+        matrix.reserve(activeNodes);
+        for (int from = 0; from < activeNodes; ++from) {
+            for (const auto& e : adj[from]) matrix.set(from, e.to);
+        }
+        matrixBuilt = true;
+    }
+    return true;
+}
+
+unsigned WaitForGraph::nextEpoch() const {
+    if (++epoch == 0) { // Wrapped around: stale marks could alias the new epoch
+        std::fill(mark.begin(), mark.end(), 0);
+        epoch = 1;
+    }
+    return epoch;
+}
+
+bool WaitForGraph::addEdge(int from, int to) {
+    reserveNode(std::max(from, to));
+    for (auto& e : adj[from]) {
+        if (e.to == to) {
+            ++e.count;
+            return false;
+        }
+    }
+    adj[from].push_back({to, 1});
+    ++edgeCount;
+    if (matrixBuilt) matrix.set(from, to);
+    return true;
+}
+
+void WaitForGraph::removeEdge(int from, int to) {
+    if (from >= static_cast<int>(adj.size())) return;
+    auto& out = adj[from];
+    for (size_t i = 0; i < out.size(); ++i) {
+        if (out[i].to == to) {
+            if (--out[i].count == 0) {
+                out[i] = out.back();
+                out.pop_back();
+                --edgeCount;
+                if (matrixBuilt) matrix.reset(from, to);
+            }
+            return;
+        }
+    }
+}
+
+void WaitForGraph::clear() {
+    for (int v = 0; v < activeNodes; ++v) adj[v].clear();
+    edgeCount = 0;
+    activeNodes = 0;
+    // Sized for the old graph; rebuilt at the new size when next needed
+    matrix.clear();
+    matrixBuilt = false;
+}
+
+bool WaitForGraph::hasEdge(int from, int to) const {
+    if (from >= static_cast<int>(adj.size())) return false;
+    for (const auto& e : adj[from]) {
+        if (e.to == to) return true;
+    }
+    return false;
+}
+
+std::vector<int> WaitForGraph::successors(int tid) const {
+    std::vector<int> result;
+    if (tid < 0 || tid >= static_cast<int>(adj.size())) return result;
+    result.reserve(adj[tid].size());
+    for (const auto& e : adj[tid]) result.push_back(e.to);
+    return result;
+}
+
+std::vector<std::pair<int, int>> WaitForGraph::edges() const {
+    std::vector<std::pair<int, int>> result;
+    result.reserve(edgeCount);
+    for (int from = 0; from < activeNodes; ++from) {
+        for (const auto& e : adj[from]) result.push_back({from, e.to});
+    }
+    return result;
+}
+
+std::vector<int> WaitForGraph::findCycleThrough(int from, int to) const {
+    if (from == to) return {from, from};
+    if (to >= static_cast<int>(adj.size())) return {};
+    if (useMatrix()) {
+        std::vector<int> cycle = matrix.findPath(to, from); // to, ..., from
+        if (!cycle.empty()) cycle.insert(cycle.begin(), from);
+        return cycle;
+    }
+    unsigned ep = nextEpoch();
+    std::vector<int> stack{to};
+    mark[to] = ep;
+    parent[to] = -1;
+    while (!stack.empty()) {
+        int node = stack.back();
+        stack.pop_back();
+        for (const auto& e : adj[node]) {
+            if (mark[e.to] == ep) continue;
+            mark[e.to] = ep;
+            parent[e.to] = node;
+            if (e.to == from) {
+                std::vector<int> cycle;
+                for (int v = from; v != -1; v = parent[v]) cycle.push_back(v);
+                std::reverse(cycle.begin(), cycle.end()); // to, ..., from
+                cycle.insert(cycle.begin(), from);
+                return cycle;
+            }
+            stack.push_back(e.to);
+        }
+    }
+    return {};
+}
+
+std::vector<int> WaitForGraph::findCycle() const {
+    if (useMatrix()) return matrix.findCycle();
+    // Iterative three-colour DFS: mark == ep means visited, onPath tracks the
+    // grey nodes so back edges are detected in O(1).
+    unsigned ep = nextEpoch();
+    std::vector<char> onPath(adj.size(), 0);
+    std::vector<std::pair<int, size_t>> stack;
+    for (int root = 0; root < activeNodes; ++root) {
+        if (mark[root] == ep || adj[root].empty()) continue;
+        mark[root] = ep;
+        onPath[root] = 1;
+        stack.push_back({root, 0});
+        while (!stack.empty()) {
+            auto& top = stack.back();
+            int node = top.first;
+            if (top.second == adj[node].size()) {
+                onPath[node] = 0;
+                stack.pop_back();
+                continue;
+            }
+            int next = adj[node][top.second++].to;
+            if (onPath[next]) {
+                std::vector<int> cycle;
+                auto start = std::find_if(stack.begin(), stack.end(),
+                                          [next](const std::pair<int, size_t>& f) { return f.first == next; });
+                for (auto it = start; it != stack.end(); ++it) cycle.push_back(it->first);
+                cycle.push_back(next);
+                return cycle;
+            }
+            if (mark[next] != ep) {
+                mark[next] = ep;
+                onPath[next] = 1;
+                stack.push_back({next, 0});
+            }
+        }
+    }
+    return {};
+}
+
+bool WaitForGraph::hasCycle() const {
+    if (useMatrix()) return matrix.hasCycle();
+    // Two epochs colour the nodes: grey while on the DFS path, black when done
+    unsigned grey = nextEpoch();
+    unsigned black = nextEpoch();
+    for (int root = 0; root < activeNodes; ++root) {
+        if (mark[root] == black || adj[root].empty()) continue;
+        mark[root] = grey;
+        dfsStack.clear();
+        dfsStack.push_back({root, 0});
+        while (!dfsStack.empty()) {
+            auto& top = dfsStack.back();
+            int node = top.first;
+            if (top.second == adj[node].size()) {
+                mark[node] = black;
+                dfsStack.pop_back();
+                continue;
+            }
+            int next = adj[node][top.second++].to;
+            if (mark[next] == grey) return true;
+            if (mark[next] != black) {
+                mark[next] = grey;
+                dfsStack.push_back({next, 0});
+            }
+        }
+    }
+    return false;
+}
+
+// Tarjan's algorithm over a graph in compressed adjacency form (node v's
+// successors are targets[offsets[v] .. offsets[v + 1])). Returns only the
+// components that contain a cycle, i.e. have more than one node.
+static std::vector<std::vector<int>> cyclicComponents(const std::vector<int>& offsets,
+                                                      const std::vector<int>& targets) {
+    int n = static_cast<int>(offsets.size()) - 1;
+    std::vector<int> index(n, -1), lowlink(n, 0);
+    std::vector<char> onStack(n, 0);
+    std::vector<int> sccStack;
+    std::vector<std::pair<int, int>> callStack; // node, next edge position
+    std::vector<std::vector<int>> result;
+    int counter = 0;
+    for (int root = 0; root < n; ++root) {
+        if (index[root] != -1) continue;
+        callStack.push_back({root, offsets[root]});
+        index[root] = lowlink[root] = counter++;
+        sccStack.push_back(root);
+        onStack[root] = 1;
+        while (!callStack.empty()) {
+            int v = callStack.back().first;
+            int& pos = callStack.back().second;
+            if (pos < offsets[v + 1]) {
+                int w = targets[pos++];
+                if (index[w] == -1) {
+                    index[w] = lowlink[w] = counter++;
+                    sccStack.push_back(w);
+                    onStack[w] = 1;
+                    callStack.push_back({w, offsets[w]});
+                } else if (onStack[w]) {
+                    lowlink[v] = std::min(lowlink[v], index[w]);
+                }
+                continue;
+            }
+            callStack.pop_back();
+            if (!callStack.empty()) {
+                int parent = callStack.back().first;
+                lowlink[parent] = std::min(lowlink[parent], lowlink[v]);
+            }
+            if (lowlink[v] != index[v]) continue;
+            std::vector<int> component;
+            int w;
+            do {
+                w = sccStack.back();
+                sccStack.pop_back();
+                onStack[w] = 0;
+                component.push_back(w);
+            } while (w != v);
+            if (component.size() > 1) result.push_back(std::move(component));
+        }
+    }
+    return result;
+}
+
+std::vector<std::vector<int>> WaitForGraph::deadlockedComponents() const {
+    std::vector<int> offsets(adj.size() + 1, 0), targets;
+    targets.reserve(edgeCount);
+    for (size_t v = 0; v < adj.size(); ++v) {
+        for (const auto& e : adj[v]) targets.push_back(e.to);
+        offsets[v + 1] = static_cast<int>(targets.size());
+    }
+    std::vector<std::vector<int>> components = cyclicComponents(offsets, targets);
+    for (auto& c : components) std::sort(c.begin(), c.end());
+    std::sort(components.begin(), components.end());
+    return components;
+}
+
+std::vector<int> WaitForGraph::breakingSet(const std::vector<std::vector<int>>& components,
+                                           const std::function<double(int)>& victimCost,
+                                           const std::function<long(int)>& age) const {
+    std::vector<int> victims;
+    std::vector<int> local(adj.size(), -1);
+    std::vector<std::vector<int>> work(components.begin(), components.end());
+    while (!work.empty()) {
+        std::vector<int> nodes = std::move(work.back());
+        work.pop_back();
+        // Subgraph induced by `nodes`, in compressed form with local indices
+        for (size_t i = 0; i < nodes.size(); ++i) local[nodes[i]] = static_cast<int>(i);
+        std::vector<int> offsets(nodes.size() + 1, 0), targets;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            for (const auto& e : adj[nodes[i]]) {
+                if (e.to < static_cast<int>(local.size()) && local[e.to] != -1) targets.push_back(local[e.to]);
+            }
+            offsets[i + 1] = static_cast<int>(targets.size());
+        }
+        for (int v : nodes) local[v] = -1;
+
+        for (const auto& scc : cyclicComponents(offsets, targets)) {
+            std::vector<int> inDegree(nodes.size(), 0), outDegree(nodes.size(), 0);
+            std::vector<char> member(nodes.size(), 0);
+            for (int v : scc) member[v] = 1;
+            for (int v : scc) {
+                for (int p = offsets[v]; p < offsets[v + 1]; ++p) {
+                    if (!member[targets[p]]) continue;
+                    ++outDegree[v];
+                    ++inDegree[targets[p]];
+                }
+            }
+            auto younger = [&](int a, int b) {
+                if (age) {
+                    long ageA = age(a), ageB = age(b);
+                    if (ageA != ageB) return ageA > ageB;
+                }
+                return a > b;
+            };
+            int best = scc.front();
+            double bestCost = victimCost(nodes[best]);
+            for (int v : scc) {
+                long long score = 1LL * inDegree[v] * outDegree[v];
+                long long bestScore = 1LL * inDegree[best] * outDegree[best];
+                double cost = victimCost(nodes[v]);
+                if (cost < bestCost ||
+                    (cost == bestCost && (score > bestScore || (score == bestScore && younger(nodes[v], nodes[best]))))) {
+                    best = v;
+                    bestCost = cost;
+                }
+            }
+            victims.push_back(nodes[best]);
+            std::vector<int> rest;
+            for (int v : scc) {
+                if (v != best) rest.push_back(nodes[v]);
+            }
+            if (rest.size() > 1) work.push_back(std::move(rest));
+        }
+    }
+    std::sort(victims.begin(), victims.end());
+    return victims;
+}